@@ -5,7 +5,7 @@ pipeline = [
 	["hash_table8.hpp", "common.h", "memory.h", "str.h", "safestl.h", "builtins.h", "error.h"],
 	["obj.h", "parser.h", "ref.h", "codeobject.h", "frame.h"],
 	["vm.h", "ceval.h", "compiler.h", "repl.h"],
-	["iter.h", "pocketpy.h"]
+	["iter.h", "cffi.h", "concurrent.h", "asyncio.h", "pocketpy.h"]
 ]
 
 copied = set()
@@ -0,0 +1,25 @@
+# compile throughput: exec() compiles every function body below,
+# but only runs the def statements and the table assignments
+import time
+
+def gen_func(i):
+    lines = ['def rule_' + str(i) + '(x, y):']
+    for j in range(50):
+        lines.append(f'    v{j} = x * {j} + y - {i}.5 + 0x{j}f')
+    lines.append("    return 'rule' + str(v0 + v49)")
+    return '\n'.join(lines)
+
+def gen_table(n):
+    return '\n'.join([f"RULE_{i} = ({i % 100}, 'tag_{i % 10}', {i % 7}.25)" for i in range(n)])
+
+src = '\n\n'.join([gen_func(i) for i in range(300)]) + '\n' + gen_table(3000) + '\n'
+
+t0 = time.time()
+for _ in range(5):
+    exec(src)
+dt = time.time() - t0
+
+assert rule_7(1, 2) == 'rule' + str((1 * 0 + 2 - 7.5 + 0x0f) + (1 * 49 + 2 - 7.5 + 0x49f))
+assert RULE_2999 == (99, 'tag_9', 3.25)
+mb = len(src) * 5 / 1024 / 1024
+print('compiled', int(mb * 100) / 100, 'MB in', int(dt * 1000), 'ms:', int(mb / dt * 100) / 100, 'MB/s')
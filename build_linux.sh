@@ -1,3 +1,3 @@
 echo '#include "pocketpy.h"' > src/tmp.cpp
-g++ -fPIC -shared -o pocketpy.so src/tmp.cpp --std=c++17 -O2 -Wall -Wno-sign-compare -Wno-unused-variable -fno-rtti
+g++ -fPIC -shared -o pocketpy.so src/tmp.cpp --std=c++17 -O2 -Wall -Wno-sign-compare -Wno-unused-variable -fno-rtti -pthread
 rm src/tmp.cpp
\ No newline at end of file
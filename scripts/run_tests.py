@@ -1,6 +1,7 @@
 import os
 import sys
 import time
+import tempfile
 
 def test_file(filepath, cpython=False):
     if cpython:
@@ -10,12 +11,22 @@ def test_file(filepath, cpython=False):
     else:
         return os.system("./pocketpy " + filepath) == 0
 
+# C API tests are built against the headers and run on their own
+def test_cpp_file(filepath):
+    exe = os.path.join(tempfile.gettempdir(), 'pk' + os.path.basename(filepath)[:-4])
+    cmd = f"g++ -o {exe} {filepath} -Isrc --std=c++17 -O1 -Wall -Wno-sign-compare -Wno-unused-variable -fno-rtti -pthread"
+    return os.system(cmd) == 0 and os.system(exe) == 0
+
 def test_dir(path):
     print("Testing directory:", path)
     for filename in os.listdir(path):
+        filepath = os.path.join(path, filename)
+        if filename.endswith('.cpp') and path == 'tests/':
+            print("> " + filepath, flush=True)
+            if not test_cpp_file(filepath): exit(1)
+            continue
         if not filename.endswith('.py'):
             continue
-        filepath = os.path.join(path, filename)
         print("> " + filepath, flush=True)
 
         if path == 'benchmarks/':
@@ -0,0 +1,320 @@
+#pragma once
+
+#include "iter.h"
+#include "concurrent.h"
+
+namespace pkpy {
+    // results of host operations, filled from any thread and drained by the event loop
+    struct _Inbox {
+        struct Item {
+            i64 id;
+            bool ok;
+            Message value;
+            Str error_type;
+            Str error_msg;
+        };
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Item> items;
+
+        void put(Item&& item){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                items.push_back(std::move(item));
+            }
+            cv.notify_one();
+        }
+    };
+
+    /// Completes one pending future from any thread, without touching the vm.
+    /// Only the first call has an effect; later ones are ignored by the loop.
+    class Completion {
+        std::shared_ptr<_Inbox> _inbox;
+        i64 _id;
+    public:
+        Completion(std::shared_ptr<_Inbox> inbox, i64 id) : _inbox(std::move(inbox)), _id(id) {}
+
+        void resolve(Message value){
+            _inbox->put(_Inbox::Item{_id, true, std::move(value), "", ""});
+        }
+
+        void reject(Str type, Str msg){
+            _inbox->put(_Inbox::Item{_id, false, Message(), std::move(type), std::move(msg)});
+        }
+    };
+}
+
+// a value set later; tasks awaiting it resume once it is done
+struct Future {
+    PY_CLASS(asyncio, Future)
+
+    enum State : uint8_t { PENDING, DONE, FAILED };
+    State state = PENDING;
+    PyVar value;                    // the result, or the exception if FAILED
+    std::vector<PyVar> waiters;     // suspended tasks
+
+    inline bool done() const { return state != PENDING; }
+
+    // complete the future and schedule its waiters
+    static void set(VM* vm, const PyVar& self, State state, PyVar value);
+
+    static PyVar result(VM* vm, const PyVar& self){
+        Future& fut = OBJ_GET(Future, self);
+        if(fut.state == PENDING) vm->RuntimeError("result is not ready");
+        if(fut.state == FAILED) vm->_error(vm->PyException_AS_C(fut.value));
+        return fut.value;
+    }
+
+    static void _register(VM* vm, PyVar mod, PyVar type){
+        vm->bind_static_method<0>(type, "__new__", [](VM* vm, pkpy::Args& args) {
+            return vm->new_object<Future>();
+        });
+
+        vm->bind_method<0>(type, "done", [](VM* vm, pkpy::Args& args) {
+            return vm->PyBool(vm->py_cast<Future>(args[0]).done());
+        });
+
+        vm->bind_method<0>(type, "result", [](VM* vm, pkpy::Args& args) {
+            vm->py_cast<Future>(args[0]);
+            return result(vm, args[0]);
+        });
+
+        vm->bind_method<1>(type, "set_result", [](VM* vm, pkpy::Args& args) {
+            vm->py_cast<Future>(args[0]);
+            set(vm, args[0], DONE, args[1]);
+            return vm->None;
+        });
+    }
+};
+
+// runs a coroutine, and the coroutines it awaits, on the event loop
+struct Task {
+    PY_CLASS(asyncio, Task)
+
+    PyVar future;                   // completes with the outermost coroutine
+    std::vector<PyVar> stack;       // coroutines awaiting each other, innermost last
+
+    static void _register(VM* vm, PyVar mod, PyVar type){
+        vm->bind_method<-1>(type, "__init__", [](VM* vm, pkpy::Args& args) {
+            vm->NotImplementedError();
+            return vm->None;
+        });
+
+        vm->bind_method<0>(type, "done", [](VM* vm, pkpy::Args& args) {
+            return vm->PyBool(OBJ_GET(Future, vm->py_cast<Task>(args[0]).future).done());
+        });
+
+        vm->bind_method<0>(type, "result", [](VM* vm, pkpy::Args& args) {
+            return Future::result(vm, vm->py_cast<Task>(args[0]).future);
+        });
+    }
+};
+
+// one per vm; all tasks run on the thread that calls asyncio.run()
+struct EventLoop {
+    PY_CLASS(asyncio, EventLoop)
+
+    struct Timer {
+        f64 when;
+        i64 seq;        // keeps timers with the same deadline in order
+        PyVar future;
+        bool operator>(const Timer& other) const {
+            return when != other.when ? when > other.when : seq > other.seq;
+        }
+    };
+
+    struct Wakeup {
+        PyVar task;
+        PyVar value;        // the result of the pending `await`, or the exception to raise there
+        bool failed;
+    };
+
+    std::deque<Wakeup> ready;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    i64 timer_seq = 0;
+    bool running = false;
+    std::shared_ptr<pkpy::_Inbox> inbox = std::make_shared<pkpy::_Inbox>();
+    emhash8::HashMap<i64, PyVar> pending;           // futures waiting for the inbox, by id
+    i64 next_pending_id = 0;
+
+    static EventLoop& get(VM* vm){
+        return OBJ_GET(EventLoop, vm->_modules["asyncio"]->attr("_loop"));
+    }
+
+    static f64 now(){
+        auto t = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration<f64>(t).count();
+    }
+
+    PyVar create_task(VM* vm, const PyVar& coro){
+        vm->py_cast<Coroutine>(coro);
+        if(OBJ_GET(Coroutine, coro).started()) vm->RuntimeError("coroutine was already awaited");
+        Task task;
+        task.future = vm->new_object<Future>();
+        task.stack.push_back(coro);
+        PyVar obj = vm->new_object<Task>(std::move(task));
+        ready.push_back(Wakeup{obj, vm->None, false});
+        return obj;
+    }
+
+    // a future that the loop completes after `seconds`
+    PyVar sleep(VM* vm, f64 seconds){
+        PyVar fut = vm->new_object<Future>();
+        timers.push(Timer{now() + std::max(seconds, 0.0), timer_seq++, fut});
+        return fut;
+    }
+
+    // a future for a host operation, and the completion the host fulfills from any thread
+    PyVar expect(VM* vm, std::unique_ptr<pkpy::Completion>& completion){
+        PyVar fut = vm->new_object<Future>();
+        i64 id = next_pending_id++;
+        pending[id] = fut;
+        completion = std::make_unique<pkpy::Completion>(inbox, id);
+        return fut;
+    }
+
+    // complete the pending futures whose results have arrived
+    void drain(VM* vm){
+        std::deque<pkpy::_Inbox::Item> items;
+        {
+            std::lock_guard<std::mutex> lock(inbox->mutex);
+            items.swap(inbox->items);
+        }
+        for(pkpy::_Inbox::Item& item : items){
+            auto it = pending.find(item.id);
+            if(it == pending.end()) continue;
+            PyVar fut = std::move(it->second);
+            pending.erase(it);
+            if(OBJ_GET(Future, fut).done()) continue;
+            if(item.ok){
+                Future::set(vm, fut, Future::DONE, item.value.to(vm));
+            }else{
+                Future::set(vm, fut, Future::FAILED, vm->PyException(pkpy::Exception(item.error_type, item.error_msg)));
+            }
+        }
+    }
+
+    // block the thread until a host result arrives or the next timer is due
+    void wait(){
+        std::unique_lock<std::mutex> lock(inbox->mutex);
+        auto has_items = [this](){ return !inbox->items.empty(); };
+        if(timers.empty()){
+            inbox->cv.wait(lock, has_items);
+        }else{
+            inbox->cv.wait_for(lock, std::chrono::duration<f64>(timers.top().when - now()), has_items);
+        }
+    }
+
+    // resume `task` with `value` (raised if `failed`) and run it until it waits on a future or finishes
+    void step(VM* vm, const PyVar& task_obj, PyVar value, bool failed){
+        Task& task = OBJ_GET(Task, task_obj);
+        while(true){
+            PyVar ret = nullptr;
+            PyVar awaited = nullptr;
+            bool thrown = failed;
+            failed = false;
+            Coroutine& coro = OBJ_GET(Coroutine, task.stack.back());
+            try{
+                awaited = coro.resume(vm, value, ret, thrown);
+            }catch(ToBeRaisedException&){
+                ret = vm->top_frame()->pop();       // the exception left on its caller
+                failed = true;
+            }catch(const pkpy::Exception& e){
+                ret = vm->PyException(e);
+                failed = true;
+            }
+            if(awaited == nullptr){
+                task.stack.pop_back();
+                if(task.stack.empty()){
+                    Future::set(vm, task.future, failed ? Future::FAILED : Future::DONE, ret);
+                    return;
+                }
+                value = ret;        // a failure is raised in the awaiting coroutine
+                continue;
+            }
+            if(awaited->is_type(Coroutine::_type(vm))){
+                if(OBJ_GET(Coroutine, awaited).started()){
+                    value = vm->PyException(pkpy::Exception("RuntimeError", "coroutine was already awaited"));
+                    failed = true;
+                }else{
+                    task.stack.push_back(awaited);
+                    value = vm->None;
+                }
+                continue;
+            }
+            PyVar fut_obj = awaited;
+            if(awaited->is_type(Task::_type(vm))) fut_obj = OBJ_GET(Task, awaited).future;
+            if(!fut_obj->is_type(Future::_type(vm))){
+                Str msg = "object " + OBJ_NAME(vm->_t(awaited)).escape(true) + " can't be used in 'await' expression";
+                value = vm->PyException(pkpy::Exception("TypeError", msg));
+                failed = true;
+                continue;
+            }
+            Future& fut = OBJ_GET(Future, fut_obj);
+            if(fut.done()){
+                value = fut.value;
+                failed = fut.state == Future::FAILED;
+                continue;
+            }
+            fut.waiters.push_back(task_obj);
+            return;
+        }
+    }
+
+    void run_until_complete(VM* vm, const PyVar& fut_obj){
+        Future& fut = OBJ_GET(Future, fut_obj);
+        while(!fut.done()){
+            drain(vm);
+            f64 t = now();
+            while(!timers.empty() && timers.top().when <= t){
+                PyVar timer_fut = timers.top().future;
+                timers.pop();
+                if(!OBJ_GET(Future, timer_fut).done()) Future::set(vm, timer_fut, Future::DONE, vm->None);
+            }
+            if(ready.empty()){
+                if(timers.empty()) forget_unobserved();
+                if(timers.empty() && pending.empty()) vm->RuntimeError("event loop is idle but the main task is not done");
+                wait();
+                continue;
+            }
+            // a batch at a time, so timers are checked between rounds
+            for(size_t n = ready.size(); n > 0; n--){
+                Wakeup item = std::move(ready.front());
+                ready.pop_front();
+                step(vm, item.task, std::move(item.value), item.failed);
+            }
+        }
+    }
+
+    // drop host futures that nothing can observe any more: no task awaits them and only `pending` holds them.
+    // Their results are ignored if they still arrive.
+    void forget_unobserved(){
+        std::vector<i64> ids;
+        for(auto& [id, fut] : pending){
+            if(fut.use_count() == 1 && OBJ_GET(Future, fut).waiters.empty()) ids.push_back(id);
+        }
+        for(i64 id : ids) pending.erase(id);
+    }
+
+    // tasks left unfinished by asyncio.run() are dropped, and so are host futures only they were awaiting
+    void clear(){
+        ready.clear();
+        timers = {};
+        for(auto& [id, fut] : pending) OBJ_GET(Future, fut).waiters.clear();
+        forget_unobserved();
+        running = false;
+    }
+
+    static void _register(VM* vm, PyVar mod, PyVar type){}
+};
+
+void Future::set(VM* vm, const PyVar& self, State state, PyVar value){
+    Future& fut = OBJ_GET(Future, self);
+    if(fut.done()) vm->RuntimeError("future is already done");
+    fut.state = state;
+    fut.value = value;
+    if(fut.waiters.empty()) return;
+    EventLoop& loop = EventLoop::get(vm);
+    for(PyVar& task : fut.waiters) loop.ready.push_back(EventLoop::Wakeup{std::move(task), value, state == FAILED});
+    fut.waiters.clear();
+}
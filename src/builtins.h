@@ -1,10 +1,6 @@
 #pragma once
 
 const char* kBuiltinsCode = R"(
-def print(*args, sep=' ', end='\n'):
-    s = sep.join([str(i) for i in args])
-    __sys_stdout_write(s + end)
-
 def round(x, ndigits=0):
     assert ndigits >= 0
     if ndigits == 0:
@@ -410,6 +406,15 @@ class set:
         return self._a.keys()
 )";
 
+const char* kAsyncioCode = R"(
+async def gather(*aws):
+    futures = [ensure_future(a) for a in aws]
+    results = []
+    for f in futures:
+        results.append(await f)
+    return results
+)";
+
 const char* kRandomCode = R"(
 def shuffle(L):
     for i in range(len(L)):
@@ -37,6 +37,14 @@ PyVar VM::run_frame(Frame* frame){
             bool _rvalue = byte.arg % 2 == 1;
             auto& attr = frame->co->names[name];
             PyVar obj = frame->pop_value(this);
+            if(_rvalue && obj->_is_shaped()){
+                // instance attributes take precedence, so a hit needs no class lookup
+                PyVar* val = obj->attr_try_get(attr.first, frame->co->_attr_cache(name));
+                if(val != nullptr){
+                    frame->push(*val);
+                    continue;
+                }
+            }
             AttrRef ref = AttrRef(obj, NameRef(attr));
             if(_rvalue) frame->push(ref.get(this, frame));
             else frame->push(PyRef(ref));
@@ -78,9 +86,14 @@ PyVar VM::run_frame(Frame* frame){
         } continue;
         case OP_BUILD_STRING: {
             pkpy::Args items = frame->pop_n_values_reversed(this, byte.arg);
-            StrStream ss;
-            for(int i=0; i<items.size(); i++) ss << PyStr_AS_C(asStr(items[i]));
-            frame->push(PyStr(ss.str()));
+            size_t size = 0;
+            for(int i=0; i<items.size(); i++){
+                items[i] = asStr(items[i]);
+                size += PyStr_AS_C(items[i]).size();
+            }
+            Str s; s.reserve(size);
+            for(int i=0; i<items.size(); i++) s += PyStr_AS_C(items[i]);
+            frame->push(PyStr(std::move(s)));
         } continue;
         case OP_LOAD_EVAL_FN: frame->push(builtins->attr(m_eval)); continue;
         case OP_LIST_APPEND: {
@@ -90,21 +103,27 @@ PyVar VM::run_frame(Frame* frame){
             fast_call(m_append, std::move(args));
         } continue;
         case OP_BUILD_CLASS: {
-            const Str& clsName = frame->co->names[byte.arg].first;
+            StrName clsName = frame->co->names[byte.arg].first;
             PyVar clsBase = frame->pop_value(this);
             if(clsBase == None) clsBase = _t(tp_object);
             check_type(clsBase, tp_type);
-            PyVar cls = new_type_object(frame->_module, clsName, clsBase);
+            PyVar cls = new_type_object(frame->_module, clsName.str(), clsBase);
+            PyVar slots = nullptr;
             while(true){
                 PyVar fn = frame->pop_value(this);
                 if(fn == None) break;
+                if(fn->is_type(tp_tuple)){
+                    slots = fn;
+                    continue;
+                }
                 const pkpy::Function& f = PyFunction_AS_C(fn);
                 setattr(cls, f.name, fn);
             }
+            if(slots != nullptr) _set_slots(cls, clsBase, PyTuple_AS_C(slots));     // after the methods it may clash with
         } continue;
         case OP_RETURN_VALUE: return frame->pop_value(this);
         case OP_PRINT_EXPR: {
-            const PyVar expr = frame->top_value(this);
+            const PyVar& expr = frame->top_value_borrowed(this);
             if(expr == None) continue;
             *_stdout << PyStr_AS_C(asRepr(expr)) << '\n';
         } continue;
@@ -112,19 +131,29 @@ PyVar VM::run_frame(Frame* frame){
         case OP_BINARY_OP: {
             pkpy::Args args(2);
             args[1] = frame->pop_value(this);
-            args[0] = frame->top_value(this);
-            frame->top() = fast_call(BINARY_SPECIAL_METHODS[byte.arg], std::move(args));
+            args[0] = frame->pop_value(this);
+            frame->push(fast_call(BINARY_SPECIAL_METHODS[byte.arg], std::move(args)));
         } continue;
         case OP_BITWISE_OP: {
             pkpy::Args args(2);
             args[1] = frame->pop_value(this);
-            args[0] = frame->top_value(this);
-            frame->top() = fast_call(BITWISE_SPECIAL_METHODS[byte.arg], std::move(args));
+            args[0] = frame->pop_value(this);
+            frame->push(fast_call(BITWISE_SPECIAL_METHODS[byte.arg], std::move(args)));
         } continue;
         case OP_INPLACE_BINARY_OP: {
             pkpy::Args args(2);
             args[1] = frame->pop_value(this);
             args[0] = frame->top_value(this);
+            // `s += x` appends in place when the variable holds the only reference
+            if(byte.arg == 0 && args[0]->is_type(tp_str) && args[1]->is_type(tp_str)){
+                PyVar* slot = PyRef_AS_C(frame->top())->slot(this, frame);
+                if(slot != nullptr && *slot == args[0] && args[0].use_count() == 2){
+                    OBJ_GET(Str, args[0]) += OBJ_GET(Str, args[1]);
+                    args[0]->_account();
+                    frame->_pop();
+                    continue;
+                }
+            }
             PyVar ret = fast_call(BINARY_SPECIAL_METHODS[byte.arg], std::move(args));
             PyRef_AS_C(frame->top())->set(this, frame, std::move(ret));
             frame->_pop();
@@ -140,12 +169,12 @@ PyVar VM::run_frame(Frame* frame){
         case OP_COMPARE_OP: {
             pkpy::Args args(2);
             args[1] = frame->pop_value(this);
-            args[0] = frame->top_value(this);
-            frame->top() = fast_call(CMP_SPECIAL_METHODS[byte.arg], std::move(args));
+            args[0] = frame->pop_value(this);
+            frame->push(fast_call(CMP_SPECIAL_METHODS[byte.arg], std::move(args)));
         } continue;
         case OP_IS_OP: {
             PyVar rhs = frame->pop_value(this);
-            bool ret_c = rhs == frame->top_value(this);
+            bool ret_c = rhs == frame->top_value_borrowed(this);
             if(byte.arg == 1) ret_c = !ret_c;
             frame->top() = PyBool(ret_c);
         } continue;
@@ -156,7 +185,7 @@ PyVar VM::run_frame(Frame* frame){
             frame->push(PyBool(ret_c));
         } continue;
         case OP_UNARY_NEGATIVE:
-            frame->top() = num_negated(frame->top_value(this));
+            frame->top() = num_negated(frame->top_value_borrowed(this));
             continue;
         case OP_UNARY_NOT: {
             PyVar obj = frame->pop_value(this);
@@ -178,13 +207,13 @@ PyVar VM::run_frame(Frame* frame){
         } continue;
         case OP_EXCEPTION_MATCH: {
             const auto& e = PyException_AS_C(frame->top());
-            Str name = frame->co->names[byte.arg].first;
+            const Str& name = frame->co->names[byte.arg].first.str();
             frame->push(PyBool(e.match_type(name)));
         } continue;
         case OP_RAISE: {
             PyVar obj = frame->pop_value(this);
             Str msg = obj == None ? "" : PyStr_AS_C(asStr(obj));
-            Str type = frame->co->names[byte.arg].first;
+            const Str& type = frame->co->names[byte.arg].first.str();
             _error(type, msg);
         } continue;
         case OP_RE_RAISE: _raise(); continue;
@@ -208,6 +237,10 @@ PyVar VM::run_frame(Frame* frame){
         } continue;
         case OP_DUP_TOP_VALUE: frame->push(frame->top_value(this)); continue;
         case OP_CALL: {
+            if(--_ticks <= 0 && _checkpoint()){
+                frame->jump_abs(frame->_ip);    // call again on resume
+                return _py_op_preempt;
+            }
             int ARGC = byte.arg & 0xFFFF;
             int KWARGC = (byte.arg >> 16) & 0xFFFF;
             pkpy::Args kwargs(0);
@@ -218,13 +251,17 @@ PyVar VM::run_frame(Frame* frame){
             if(ret == _py_op_call) return ret;
             frame->push(std::move(ret));
         } continue;
-        case OP_JUMP_ABSOLUTE: frame->jump_abs(byte.arg); continue;
+        case OP_JUMP_ABSOLUTE:
+            frame->jump_abs(byte.arg);
+            if(byte.arg <= frame->_ip && --_ticks <= 0 && _checkpoint()) return _py_op_preempt;
+            continue;
         case OP_SAFE_JUMP_ABSOLUTE: frame->jump_abs_safe(byte.arg); continue;
         case OP_GOTO: {
-            const Str& label = frame->co->names[byte.arg].first;
+            StrName label = frame->co->names[byte.arg].first;
             int* target = frame->co->labels.try_get(label);
-            if(target == nullptr) _error("KeyError", "label '" + label + "' not found");
+            if(target == nullptr) _error("KeyError", "label '" + label.str() + "' not found");
             frame->jump_abs_safe(*target);
+            if(--_ticks <= 0 && _checkpoint()) return _py_op_preempt;
         } continue;
         case OP_GET_ITER: {
             PyVar obj = frame->pop_value(this);
@@ -247,18 +284,19 @@ PyVar VM::run_frame(Frame* frame){
         case OP_LOOP_CONTINUE: {
             int blockStart = frame->co->blocks[byte.block].start;
             frame->jump_abs(blockStart);
+            if(--_ticks <= 0 && _checkpoint()) return _py_op_preempt;
         } continue;
         case OP_LOOP_BREAK: {
             int blockEnd = frame->co->blocks[byte.block].end;
             frame->jump_abs_safe(blockEnd);
         } continue;
         case OP_JUMP_IF_FALSE_OR_POP: {
-            const PyVar expr = frame->top_value(this);
+            const PyVar& expr = frame->top_value_borrowed(this);
             if(asBool(expr)==False) frame->jump_abs(byte.arg);
             else frame->pop_value(this);
         } continue;
         case OP_JUMP_IF_TRUE_OR_POP: {
-            const PyVar expr = frame->top_value(this);
+            const PyVar& expr = frame->top_value_borrowed(this);
             if(asBool(expr)==True) frame->jump_abs(byte.arg);
             else frame->pop_value(this);
         } continue;
@@ -271,25 +309,17 @@ PyVar VM::run_frame(Frame* frame){
             frame->push(PySlice(s));
         } continue;
         case OP_IMPORT_NAME: {
-            const Str& name = frame->co->names[byte.arg].first;
-            auto it = _modules.find(name);
-            if(it == _modules.end()){
-                auto it2 = _lazy_modules.find(name);
-                if(it2 == _lazy_modules.end()){
-                    _error("ImportError", "module " + name.escape(true) + " not found");
-                }else{
-                    const Str& source = it2->second;
-                    CodeObject_ code = compile(source, name, EXEC_MODE);
-                    PyVar _m = new_module(name);
-                    _exec(code, _m, pkpy::make_shared<pkpy::NameDict>());
-                    frame->push(_m);
-                    _lazy_modules.erase(it2);
-                }
-            }else{
-                frame->push(it->second);
-            }
+            StrName name = frame->co->names[byte.arg].first;
+            frame->push(import_module(name));
         } continue;
         case OP_YIELD_VALUE: return _py_op_yield;
+        case OP_AWAIT: return _py_op_yield;
+        case OP_AWAIT_RESULT: {
+            if(!frame->_throw_on_resume) continue;
+            frame->_throw_on_resume = false;
+            PyVar obj = frame->pop_value(this);
+            _error(PyException_AS_C(obj));
+        } continue;
         // TODO: using "goto" inside with block may cause __exit__ not called
         case OP_WITH_ENTER: call(frame->pop_value(this), __enter__); continue;
         case OP_WITH_EXIT: call(frame->pop_value(this), __exit__); continue;
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "vm.h"
+
+// an opaque host pointer, compared by address
+struct VoidP {
+    PY_CLASS(builtins, void_p)
+
+    void* ptr;
+    VoidP(void* ptr) : ptr(ptr) {}
+
+    static void _register(VM* vm, PyVar mod, PyVar type){
+        vm->bind_method<-1>(type, "__init__", [](VM* vm, pkpy::Args& args) {
+            vm->NotImplementedError();
+            return vm->None;
+        });
+
+        vm->bind_method<0>(type, "__repr__", [](VM* vm, pkpy::Args& args) {
+            VoidP& self = vm->py_cast<VoidP>(args[0]);
+            StrStream ss;
+            ss << "<void* at " << self.ptr << ">";
+            return vm->PyStr(ss.str());
+        });
+
+        vm->bind_method<1>(type, "__eq__", [](VM* vm, pkpy::Args& args) {
+            if(!args[1]->is_type(VoidP::_type(vm))) return vm->False;
+            return vm->PyBool(vm->py_cast<VoidP>(args[0]).ptr == OBJ_GET(VoidP, args[1]).ptr);
+        });
+
+        vm->bind_method<1>(type, "__ne__", [](VM* vm, pkpy::Args& args) {
+            if(!args[1]->is_type(VoidP::_type(vm))) return vm->True;
+            return vm->PyBool(vm->py_cast<VoidP>(args[0]).ptr != OBJ_GET(VoidP, args[1]).ptr);
+        });
+    }
+};
+
+namespace pkpy {
+    // PyVar -> C++; strings are views into the argument and live as long as it does
+    template<typename T>
+    decltype(auto) py_to_c(VM* vm, const PyVar& obj){
+        using U = std::decay_t<T>;
+        if constexpr(std::is_same_v<U, PyVar>){
+            return (const PyVar&)obj;
+        }else if constexpr(std::is_same_v<U, bool>){
+            vm->check_type(obj, vm->tp_bool);
+            return obj == vm->True;
+        }else if constexpr(std::is_integral_v<U>){
+            return (U)vm->PyInt_AS_C(obj);
+        }else if constexpr(std::is_floating_point_v<U>){
+            return (U)vm->num_to_float(obj);
+        }else if constexpr(std::is_same_v<U, const char*>){
+            return vm->PyStr_AS_C(obj).c_str();
+        }else if constexpr(std::is_same_v<U, std::string_view>){
+            return std::string_view(vm->PyStr_AS_C(obj));
+        }else if constexpr(std::is_same_v<U, Str> || std::is_same_v<U, std::string>){
+            return (const Str&)vm->PyStr_AS_C(obj);
+        }else if constexpr(std::is_pointer_v<U>){
+            if(obj == vm->None) return (U)nullptr;
+            return (U)vm->py_cast<VoidP>(obj).ptr;
+        }else{
+            static_assert(std::is_same_v<U, void>, "unsupported native argument type");
+        }
+    }
+
+    // C++ -> PyVar
+    template<typename T>
+    PyVar c_to_py(VM* vm, T&& value){
+        using U = std::decay_t<T>;
+        if constexpr(std::is_same_v<U, PyVar>){
+            return std::forward<T>(value);
+        }else if constexpr(std::is_same_v<U, bool>){
+            return vm->PyBool(value);
+        }else if constexpr(std::is_integral_v<U>){
+            return vm->PyInt((i64)value);
+        }else if constexpr(std::is_floating_point_v<U>){
+            return vm->PyFloat((f64)value);
+        }else if constexpr(std::is_same_v<U, const char*> || std::is_same_v<U, char*>){
+            if(value == nullptr) return vm->None;
+            return vm->PyStr(Str(value));
+        }else if constexpr(std::is_same_v<U, std::string_view>){
+            return vm->PyStr(Str(value.data(), value.size()));
+        }else if constexpr(std::is_same_v<U, Str> || std::is_same_v<U, std::string>){
+            return vm->PyStr(Str(std::forward<T>(value)));
+        }else if constexpr(std::is_pointer_v<U>){
+            if(value == nullptr) return vm->None;
+            return vm->new_object<VoidP>((void*)value);
+        }else{
+            static_assert(std::is_same_v<U, void>, "unsupported native return type");
+        }
+    }
+
+    // a leading `VM*` parameter receives the calling vm and is not a python argument
+    template<typename R, typename... P>
+    struct _NativeSig { using Ret = R; using Params = std::tuple<P...>; static constexpr bool kVM = false; };
+    template<typename R, typename... P>
+    struct _NativeSig<R, VM*, P...> { using Ret = R; using Params = std::tuple<P...>; static constexpr bool kVM = true; };
+
+    template<typename F>
+    struct _FnTraits : _FnTraits<decltype(&F::operator())> {};
+    template<typename R, typename... P>
+    struct _FnTraits<R(*)(P...)> : _NativeSig<R, P...> {};
+    template<typename R, typename C, typename... P>
+    struct _FnTraits<R(C::*)(P...)> : _NativeSig<R, P...> {};
+    template<typename R, typename C, typename... P>
+    struct _FnTraits<R(C::*)(P...) const> : _NativeSig<R, P...> {};
+
+    template<typename R, bool kVM, typename... P, typename F, size_t... Is>
+    PyVar _call_native(VM* vm, F& fn, Args& args, std::index_sequence<Is...>){
+        if constexpr(std::is_void_v<R>){
+            if constexpr(kVM) fn(vm, py_to_c<P>(vm, args[Is])...);
+            else fn(py_to_c<P>(vm, args[Is])...);
+            return vm->None;
+        }else{
+            if constexpr(kVM) return c_to_py(vm, fn(vm, py_to_c<P>(vm, args[Is])...));
+            else return c_to_py(vm, fn(py_to_c<P>(vm, args[Is])...));
+        }
+    }
+
+    template<typename Sig, typename F, typename... P>
+    void _bind_native(VM* vm, PyVar obj, Str name, F&& fn, std::tuple<P...>*){
+        vm->bind_func<sizeof...(P)>(obj, name, [fn=std::forward<F>(fn)](VM* vm, Args& args) mutable {
+            return _call_native<typename Sig::Ret, Sig::kVM, P...>(vm, fn, args, std::index_sequence_for<P...>{});
+        });
+    }
+
+    /// Bind a C++ function pointer or lambda as `obj.name`.
+    /// Arguments and the return value are converted by their static types.
+    template<typename F>
+    void bind_native(VM* vm, PyVar obj, Str name, F&& fn){
+        using Fn = std::decay_t<F>;
+        using Sig = _FnTraits<Fn>;
+        _bind_native<Sig>(vm, obj, name, Fn(std::forward<F>(fn)), (typename Sig::Params*)nullptr);
+    }
+}
+
+// a reference-counted value handle for the C API
+struct PkHandle {
+    inline static std::atomic<i64> live_count = 0;
+
+    static constexpr int kBorrowed = -1;       // the argument of a host function, alive during the call
+
+    std::shared_ptr<pkpy::Heap> heap;       // credited when the object is freed; null if borrowed
+    PyVar obj;
+    int ref_count;
+    PkHandle(std::shared_ptr<pkpy::Heap> heap, PyVar obj) : heap(std::move(heap)), obj(std::move(obj)), ref_count(1) { live_count++; }
+    PkHandle(PyVar obj, int ref_count) : obj(std::move(obj)), ref_count(ref_count) { live_count++; }
+    ~PkHandle(){ live_count--; }
+};
+
+// borrowed handles for the arguments of a host function; up to 8 of them need no allocation
+class _PkArgv {
+    static constexpr int kInline = 8;
+    std::optional<PkHandle> _inline[kInline];
+    PkHandle* _inline_ptrs[kInline];
+    std::vector<std::optional<PkHandle>> _more;
+    std::vector<PkHandle*> _more_ptrs;
+    PkHandle** _ptrs = _inline_ptrs;
+public:
+    _PkArgv(const pkpy::Args& args){
+        int n = args.size();
+        std::optional<PkHandle>* handles = _inline;
+        if(n > kInline){
+            _more.resize(n);
+            _more_ptrs.resize(n);
+            handles = _more.data();
+            _ptrs = _more_ptrs.data();
+        }
+        for(int i=0; i<n; i++) _ptrs[i] = &handles[i].emplace(args[i], PkHandle::kBorrowed);
+    }
+
+    inline PkHandle** data() noexcept { return _ptrs; }
+};
+
+// error raised by a host function through `pkpy_set_error`
+static THREAD_LOCAL Str _pk_host_error;
+static THREAD_LOCAL bool _pk_host_error_set = false;
+// python error caught by the last failed C API call made from inside a host function.
+// It is raised when the host function returns nullptr, so it never unwinds through C frames,
+// unless the host handled it and called `pkpy_clear_error`
+struct _PkPendingError {
+    std::exception_ptr exception;
+    PyVar raised;       // the exception that a ToBeRaisedException left on the calling frame
+
+    inline bool empty() const noexcept { return exception == nullptr && raised == nullptr; }
+
+    [[noreturn]] void raise(VM* vm){
+        if(raised != nullptr){
+            vm->top_frame()->push(std::move(raised));
+            throw ToBeRaisedException();
+        }
+        std::rethrow_exception(exception);
+    }
+};
+static THREAD_LOCAL _PkPendingError _pk_pending_error;
+
+// run `f` for the C API; return nullptr on error
+template<typename F>
+PyVarOrNull _pk_guard(VM* vm, F&& f){
+    pkpy::_HeapScope heap_scope(vm->heap.get());
+    if(!vm->callstack.empty()){
+        try{
+            return f();
+        }catch(ToBeRaisedException&){
+            _pk_pending_error = {nullptr, vm->top_frame()->pop()};
+            return nullptr;
+        }catch(...){
+            _pk_pending_error = {std::current_exception(), nullptr};
+            return nullptr;
+        }
+    }
+    PyVarOrNull ret = nullptr;
+    try{
+        ret = f();
+    }catch(const pkpy::Exception& e){
+        *vm->_stderr << e.summary() << '\n';
+        vm->callstack = {};
+    }catch(const std::exception& e){
+        *vm->_stderr << "A std::exception occurred! It may be a bug, please report it!!\n";
+        *vm->_stderr << e.what() << '\n';
+        vm->callstack = {};
+    }
+    vm->flush_output();
+    return ret;
+}
+
+inline PkHandle* _pk_handle(VM* vm, PyVarOrNull obj){
+    return obj != nullptr ? new PkHandle(vm->heap, std::move(obj)) : nullptr;
+}
+
+// a handle to the object made by `f`, charged to the heap of `vm`
+template<typename F>
+PkHandle* _pk_new_handle(VM* vm, F&& f){
+    pkpy::_HeapScope heap_scope(vm->heap.get());
+    return new PkHandle(vm->heap, f());
+}
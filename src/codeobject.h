@@ -52,6 +52,7 @@ struct CodeObject {
     pkpy::shared_ptr<SourceData> src;
     Str name;
     bool is_generator = false;
+    bool is_coroutine = false;
 
     CodeObject(pkpy::shared_ptr<SourceData> src, Str name) {
         this->src = src;
@@ -60,24 +61,61 @@ struct CodeObject {
 
     std::vector<Bytecode> codes;
     pkpy::List consts;
-    std::vector<std::pair<Str, NameScope>> names;
-    emhash8::HashMap<Str, int> global_names;
+    std::vector<std::pair<StrName, NameScope>> names;
+    emhash8::HashMap<StrName, int> global_names;
     std::vector<CodeBlock> blocks = { CodeBlock{NO_BLOCK, -1} };
-    emhash8::HashMap<Str, int> labels;
+    emhash8::HashMap<StrName, int> labels;
+
+    struct _NameHash {
+        size_t operator()(const std::pair<StrName, NameScope>& p) const { return p.first.hash() ^ p.second; }
+    };
+    // compile-time lookup tables, allocated on first use
+    struct _Index {
+        emhash8::HashMap<std::pair<StrName, NameScope>, int, _NameHash> names;
+        emhash8::HashMap<i64, int> ints;
+        emhash8::HashMap<i64, int> floats;      // keyed by bit pattern, so 0.0 and -0.0 stay apart
+        emhash8::HashMap<Str, int> strs;
+    };
+    std::unique_ptr<_Index> _index;
+    static const int kLinearNames = 8;     // below this, scanning `names` beats hashing
+
+    _Index& _get_index(){
+        if(_index == nullptr) _index = std::make_unique<_Index>();
+        return *_index;
+    }
+
+
+    // per name, for the attribute loads of this code; allocated on first use
+    std::vector<pkpy::_AttrCache> _attr_caches;
+
+    inline pkpy::_AttrCache& _attr_cache(int name){
+        if(name >= (int)_attr_caches.size()) _attr_caches.resize(names.size());
+        return _attr_caches[name];
+    }
 
     void optimize(VM* vm);
 
-    bool add_label(const Str& label){
+    bool add_label(StrName label){
         if(labels.contains(label)) return false;
         labels[label] = codes.size();
         return true;
     }
 
-    int add_name(Str name, NameScope scope){
+    int add_name(StrName name, NameScope scope){
         if(scope == NAME_LOCAL && global_names.contains(name)) scope = NAME_GLOBAL;
         auto p = std::make_pair(name, scope);
-        for(int i=0; i<names.size(); i++){
-            if(names[i] == p) return i;
+        if(names.size() < kLinearNames){
+            for(int i=0; i<names.size(); i++){
+                if(names[i] == p) return i;
+            }
+        }else{
+            auto& index = _get_index().names;
+            if(index.empty()){
+                for(int i=0; i<names.size(); i++) index[names[i]] = i;
+            }
+            auto it = index.find(p);
+            if(it != index.end()) return it->second;
+            index[p] = names.size();
         }
         names.push_back(p);
         return names.size() - 1;
@@ -88,6 +126,16 @@ struct CodeObject {
         return consts.size() - 1;
     }
 
+    template<typename K>
+    int add_const(emhash8::HashMap<K, int> _Index::* map, const K& key, const PyVar& v){
+        auto& index = _get_index().*map;
+        auto it = index.find(key);
+        if(it != index.end()) return it->second;
+        int i = add_const(v);
+        index[key] = i;
+        return i;
+    }
+
     /************************************************/
     int _curr_block_i = 0;
     bool _rvalue = false;
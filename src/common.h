@@ -18,11 +18,22 @@
 #include <cstring>
 #include <chrono>
 #include <string_view>
+#include <optional>
 #include <queue>
 #include <iomanip>
 #include <memory>
 #include <functional>
 #include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <list>
+#include <charconv>
 // #include <filesystem>
 // namespace fs = std::filesystem;
 
@@ -60,7 +71,6 @@ void* tid() {
 	return (void*)(&_x);
 }
 
-//#define THREAD_LOCAL thread_local
-#define THREAD_LOCAL
+#define THREAD_LOCAL thread_local
 
 #define RAW(T) std::remove_const_t<std::remove_reference_t<T>>
\ No newline at end of file
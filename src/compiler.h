@@ -26,6 +26,20 @@ class Compiler {
     emhash8::HashMap<TokenIndex, GrammarRule> rules;
 
     CodeObject_ co() const{ return codes.top(); }
+
+    // ints, floats and strs are deduplicated within a code object
+    int add_const(PyVar v){
+        CodeObject* c = co().get();
+        if(v->is_type(vm->tp_int)) return c->add_const(&CodeObject::_Index::ints, vm->PyInt_AS_C(v), v);
+        if(v->is_type(vm->tp_float)){
+            f64 f = vm->PyFloat_AS_C(v);
+            i64 bits;
+            memcpy(&bits, &f, sizeof(f64));
+            return c->add_const(&CodeObject::_Index::floats, bits, v);
+        }
+        if(v->is_type(vm->tp_str)) return c->add_const(&CodeObject::_Index::strs, vm->PyStr_AS_C(v), v);
+        return c->add_const(v);
+    }
     CompileMode mode() const{ return parser->src->mode; }
     NameScope name_scope() const { return codes.size()>1 ? NAME_LOCAL : NAME_GLOBAL; }
 
@@ -67,6 +81,7 @@ public:
         rules[TK("True")] =     { METHOD(exprValue),     NO_INFIX };
         rules[TK("False")] =    { METHOD(exprValue),     NO_INFIX };
         rules[TK("lambda")] =   { METHOD(exprLambda),    NO_INFIX };
+        rules[TK("await")] =    { METHOD(exprAwait),     NO_INFIX };
         rules[TK("None")] =     { METHOD(exprValue),     NO_INFIX };
         rules[TK("...")] =      { METHOD(exprValue),     NO_INFIX };
         rules[TK("@id")] =      { METHOD(exprName),      NO_INFIX };
@@ -151,32 +166,68 @@ private:
     }
 
     void eat_number() {
-        static const std::regex pattern("^(0x)?[0-9a-fA-F]+(\\.[0-9]+)?");
-        std::smatch m;
-
-        const char* i = parser->token_start;
-        while(*i != '\n' && *i != '\0') i++;
-        std::string s = std::string(parser->token_start, i);
-
-        try{
-            if (std::regex_search(s, m, pattern)) {
-                // here is m.length()-1, since the first char was eaten by lex_token()
-                for(int j=0; j<m.length()-1; j++) parser->eatchar();
-
-                int base = 10;
-                size_t size;
-                if (m[1].matched) base = 16;
-                if (m[2].matched) {
-                    if(base == 16) SyntaxError("hex literal should not contain a dot");
-                    parser->set_next_token(TK("@num"), vm->PyFloat(std::stod(m[0], &size)));
-                } else {
-                    parser->set_next_token(TK("@num"), vm->PyInt(std::stoll(m[0], &size, base)));
+        // token_start points at the first char, which may be '.' for floats like `.5`
+        const char* p = parser->token_start;
+        int base = 10;
+        if(p[0] == '0'){
+            switch(p[1]){
+                case 'x': case 'X': base = 16; break;
+                case 'o': case 'O': base = 8; break;
+                case 'b': case 'B': base = 2; break;
+            }
+            if(base != 10) p += 2;
+        }
+
+        std::string buff;   // the literal with underscores removed
+        auto is_dec = [](char c){ return c >= '0' && c <= '9'; };
+        auto is_digit = [base](char c){
+            if(base == 16) return isxdigit(c) != 0;
+            return c >= '0' && c < '0' + base;
+        };
+        auto eat_digits = [&](auto pred){
+            if(!pred(*p)) return false;
+            while(true){
+                if(pred(*p)) buff += *p++;
+                else if(*p == '_' && pred(p[1])) p++;
+                else break;
+            }
+            return true;
+        };
+
+        bool is_float = false;
+        bool ok = eat_digits(is_digit);
+        if(base == 10){
+            // `1.` is a float, but `1..` and `1.x` are not
+            if(*p == '.' && (ok ? !(isalpha(p[1]) || p[1] == '_' || p[1] == '.') : is_dec(p[1]))){
+                is_float = true;
+                buff += *p++;
+                ok = eat_digits(is_dec) || ok;
+            }
+            if(ok && (*p == 'e' || *p == 'E')){
+                const char* q = p + 1;
+                if(*q == '+' || *q == '-') q++;
+                if(is_dec(*q)){
+                    is_float = true;
+                    buff.append(p, q);
+                    p = q;
+                    eat_digits(is_dec);
                 }
-                if (size != m.length()) UNREACHABLE();
             }
-        }catch(std::exception& _){
-            SyntaxError("invalid number literal");
-        } 
+        }
+        if(!ok || isalnum(*p) || *p == '_') SyntaxError("invalid number literal");
+        parser->curr_char = p;
+
+        if(is_float){
+            f64 value;
+            if(parse_float(buff, value) != std::errc()) SyntaxError("invalid number literal");
+            parser->set_next_token(TK("@num"), vm->PyFloat(value));
+        }else{
+            i64 value;
+            std::errc ec = parse_int(buff, value, base);
+            if(ec == std::errc::result_out_of_range) SyntaxError("int literal is too large");
+            if(ec != std::errc()) SyntaxError("invalid number literal");
+            parser->set_next_token(TK("@num"), vm->PyInt(value));
+        }
     }
 
     void lex_token(){
@@ -213,6 +264,10 @@ private:
                 case '^': parser->set_next_token_2('=', TK("^"), TK("^=")); return;
                 case '?': parser->set_next_token(TK("?")); return;
                 case '.': {
+                    if(isdigit(parser->peekchar())) {
+                        eat_number();
+                        return;
+                    }
                     if(parser->matchchar('.')) {
                         if(parser->matchchar('.')) {
                             parser->set_next_token(TK("..."));
@@ -307,8 +362,8 @@ private:
 
     // not sure this will work
     TokenIndex peek_next() {
-        if(parser->nexts.empty()) return TK("@eof");
-        return parser->nexts.front().type;
+        if(parser->nexts_i == parser->nexts.size()) return TK("@eof");
+        return parser->nexts[parser->nexts_i].type;
     }
 
     bool match(TokenIndex expected) {
@@ -350,7 +405,7 @@ private:
 
     void exprLiteral() {
         PyVar value = parser->prev.value;
-        int index = co()->add_const(value);
+        int index = add_const(value);
         emit(OP_LOAD_CONST, index);
     }
 
@@ -366,18 +421,18 @@ private:
             std::smatch m = *it;
             if (i < m.position()) {
                 std::string literal = s.substr(i, m.position() - i);
-                emit(OP_LOAD_CONST, co()->add_const(vm->PyStr(literal)));
+                emit(OP_LOAD_CONST, add_const(vm->PyStr(literal)));
                 size++;
             }
             emit(OP_LOAD_EVAL_FN);
-            emit(OP_LOAD_CONST, co()->add_const(vm->PyStr(m[1].str())));
+            emit(OP_LOAD_CONST, add_const(vm->PyStr(m[1].str())));
             emit(OP_CALL, 1);
             size++;
             i = (int)(m.position() + m.length());
         }
         if (i < s.size()) {
             std::string literal = s.substr(i, s.size() - i);
-            emit(OP_LOAD_CONST, co()->add_const(vm->PyStr(literal)));
+            emit(OP_LOAD_CONST, add_const(vm->PyStr(literal)));
             size++;
         }
         emit(OP_BUILD_STRING, size);
@@ -390,7 +445,7 @@ private:
             _compile_f_args(func, false);
             consume(TK(":"));
         }
-        func.code = pkpy::make_shared<CodeObject>(parser->src, func.name);
+        func.code = pkpy::make_shared<CodeObject>(parser->src, func.name.str());
         this->codes.push(func.code);
         EXPR_TUPLE();
         emit(OP_RETURN_VALUE);
@@ -400,6 +455,13 @@ private:
         if(name_scope() == NAME_LOCAL) emit(OP_SETUP_CLOSURE);
     }
 
+    void exprAwait() {
+        if(!co()->is_coroutine) SyntaxError("'await' outside async function");
+        parse_expression(PREC_CALL);
+        emit(OP_AWAIT);
+        emit(OP_AWAIT_RESULT);
+    }
+
     void exprAssign() {
         co()->_rvalue = true;
         TokenIndex op = parser->prev.type;
@@ -594,7 +656,7 @@ __LISTCOMP:
             if(peek() == TK("@id") && peek_next() == TK("=")) {
                 consume(TK("@id"));
                 const Str& key = parser->prev.str();
-                emit(OP_LOAD_CONST, co()->add_const(vm->PyStr(key)));
+                emit(OP_LOAD_CONST, add_const(vm->PyStr(key)));
                 consume(TK("="));
                 co()->_rvalue=true; EXPR(); co()->_rvalue=false;
                 KWARGC++;
@@ -850,6 +912,7 @@ __LISTCOMP:
             emit(OP_LOOP_CONTINUE);
         } else if (match(TK("yield"))) {
             if (codes.size() == 1) SyntaxError("'yield' outside function");
+            if (co()->is_coroutine) SyntaxError("'yield' inside async function");
             co()->_rvalue = true;
             EXPR_TUPLE();
             co()->_rvalue = false;
@@ -879,12 +942,15 @@ __LISTCOMP:
             compile_from_import();
         } else if (match(TK("def"))){
             compile_function();
+        } else if (match(TK("async"))){
+            consume(TK("def"));
+            compile_function(true);
         } else if (match(TK("try"))) {
             compile_try_except();
         }else if(match(TK("assert"))){
             EXPR();
             if (match(TK(","))) EXPR();
-            else emit(OP_LOAD_CONST, co()->add_const(vm->PyStr("")));
+            else emit(OP_LOAD_CONST, add_const(vm->PyStr("")));
             emit(OP_ASSERT);
             consume_end_stmt();
         } else if(match(TK("with"))){
@@ -955,7 +1021,7 @@ __LISTCOMP:
         }
         emit(OP_LOAD_NONE);
         is_compiling_class = true;
-        compile_block_body(&Compiler::compile_function);
+        compile_block_body(&Compiler::compile_method);
         is_compiling_class = false;
         if(super_cls_name_idx == -1) emit(OP_LOAD_NONE);
         else emit(OP_LOAD_NAME_REF, super_cls_name_idx);
@@ -1002,11 +1068,43 @@ __LISTCOMP:
         } while (match(TK(",")));
     }
 
-    void compile_function(){
-        if(is_compiling_class){
-            if(match(TK("pass"))) return;
-            consume(TK("def"));
+    void compile_method(){
+        if(match(TK("pass"))) return;
+        if(peek() == TK("@id") && parser->curr.str() == "__slots__"){
+            compile_slots();
+            return;
+        }
+        bool is_async = match(TK("async"));
+        consume(TK("def"));
+        compile_function(is_async, true);
+    }
+
+    // `__slots__ = ('a', 'b')` in a class body; the names are left as a tuple for OP_BUILD_CLASS
+    void compile_slots(){
+        consume(TK("@id"));
+        consume(TK("="));
+        pkpy::List names;
+        if(match(TK("@str"))){
+            names.push_back(parser->prev.value);
+        }else{
+            TokenIndex close = match(TK("(")) ? TK(")") : (consume(TK("[")), TK("]"));
+            match_newlines();
+            while(!match(close)){
+                consume(TK("@str"));
+                names.push_back(parser->prev.value);
+                match_newlines();
+                if(!match(TK(","))){
+                    consume(close);
+                    break;
+                }
+                match_newlines();
+            }
         }
+        consume_end_stmt();
+        emit(OP_LOAD_CONST, co()->add_const(vm->PyTuple(std::move(names))));
+    }
+
+    void compile_function(bool is_async=false, bool is_method=false){
         pkpy::Function func;
         consume(TK("@id"));
         func.name = parser->prev.str();
@@ -1016,14 +1114,15 @@ __LISTCOMP:
             consume(TK(")"));
         }
         if(match(TK("->"))) consume(TK("@id")); // eat type hints
-        func.code = pkpy::make_shared<CodeObject>(parser->src, func.name);
+        func.code = pkpy::make_shared<CodeObject>(parser->src, func.name.str());
+        func.code->is_coroutine = is_async;
         this->codes.push(func.code);
         compile_block_body();
         func.code->optimize(vm);
         this->codes.pop();
         emit(OP_LOAD_FUNCTION, co()->add_const(vm->PyFunction(func)));
         if(name_scope() == NAME_LOCAL) emit(OP_SETUP_CLOSURE);
-        if(!is_compiling_class) emit(OP_STORE_NAME, co()->add_name(func.name, name_scope()));
+        if(!is_method) emit(OP_STORE_NAME, co()->add_name(func.name, name_scope()));
     }
 
     PyVarOrNull read_literal(){
@@ -1077,7 +1176,7 @@ public:
             return code;
         }else if(mode()==JSON_MODE){
             PyVarOrNull value = read_literal();
-            if(value != nullptr) emit(OP_LOAD_CONST, code->add_const(value));
+            if(value != nullptr) emit(OP_LOAD_CONST, add_const(value));
             else if(match(TK("{"))) exprMap();
             else if(match(TK("["))) exprList();
             else SyntaxError("expect a JSON object or array");
@@ -0,0 +1,635 @@
+#pragma once
+
+#include "vm.h"
+
+#if !defined(__EMSCRIPTEN__)
+#define PK_USE_THREADS
+#endif
+
+namespace pkpy {
+    struct _FuncBlob;
+    class _Shipper;
+    class _Unshipper;
+
+    // a value copied out of one VM's heap, to be rebuilt in another
+    struct Message {
+        enum Kind : uint8_t { NONE, BOOL, INT, FLOAT, STR, BYTES, TUPLE, LIST, FUNCTION, MODULE, BUILTIN };
+        Kind kind = NONE;
+        i64 i = 0;          // also holds bool
+        f64 f = 0;
+        std::string s;      // also the name of a module or builtin
+        std::vector<Message> items;
+        std::shared_ptr<const _FuncBlob> func;
+
+        static Message from(VM* vm, const PyVar& obj, int depth=0, _Shipper* shipper=nullptr);
+        PyVar to(VM* vm, _Unshipper* unshipper=nullptr) const;
+    };
+
+    struct _SourceBlob {
+        std::string source;
+        Str filename;
+        CompileMode mode;
+    };
+
+    // a CodeObject without any PyVar, so it can cross threads
+    struct _CodeBlob {
+        std::shared_ptr<const _SourceBlob> src;
+        Str name;
+        bool is_generator;
+        bool is_coroutine;
+        std::vector<Bytecode> codes;
+        std::vector<Message> consts;
+        std::vector<std::pair<StrName, NameScope>> names;
+        emhash8::HashMap<StrName, int> global_names;
+        std::vector<CodeBlock> blocks;
+        emhash8::HashMap<StrName, int> labels;
+    };
+
+    struct _FuncBlob {
+        StrName name;
+        std::shared_ptr<const _CodeBlob> code;
+        std::vector<StrName> args;
+        StrName starred_arg;
+        std::vector<std::pair<StrName, Message>> kwargs;    // in kwargs_order
+        bool has_closure = false;
+        std::vector<std::pair<StrName, Message>> closure;   // only the captured names it uses
+        std::vector<std::pair<StrName, Message>> globals;   // only for the function being sent
+    };
+
+    // copies functions out of a VM, along with their code, defaults, closures and the globals they use
+    class _Shipper {
+        VM* vm;
+        std::map<const SourceData*, std::shared_ptr<const _SourceBlob>> _sources;
+        std::map<const CodeObject*, std::shared_ptr<const _CodeBlob>> _codes;
+
+        std::shared_ptr<const _SourceBlob> _source(const pkpy::shared_ptr<SourceData>& src){
+            auto& blob = _sources[src.get()];
+            if(blob == nullptr) blob = std::make_shared<_SourceBlob>(_SourceBlob{src->source, src->filename, src->mode});
+            return blob;
+        }
+
+        std::shared_ptr<const _CodeBlob> _code(const CodeObject_& co){
+            auto it = _codes.find(co.get());
+            if(it != _codes.end()) return it->second;
+            auto blob = std::make_shared<_CodeBlob>();
+            blob->src = _source(co->src);
+            blob->name = co->name;
+            blob->is_generator = co->is_generator;
+            blob->is_coroutine = co->is_coroutine;
+            blob->codes = co->codes;
+            for(const PyVar& c : co->consts) blob->consts.push_back(Message::from(vm, c, 0, this));
+            blob->names = co->names;
+            blob->global_names = co->global_names;
+            blob->blocks = co->blocks;
+            blob->labels = co->labels;
+            _codes[co.get()] = blob;
+            return blob;
+        }
+
+        // names a function may load, including from nested functions
+        void _collect_names(const CodeObject_& co, std::vector<StrName>& out){
+            for(auto& p : co->names){
+                if(p.second == NAME_LOCAL || p.second == NAME_GLOBAL) out.push_back(p.first);
+            }
+            for(const PyVar& c : co->consts){
+                if(c->is_type(vm->tp_function)) _collect_names(vm->PyFunction_AS_C(c).code, out);
+            }
+        }
+
+        bool _transferable(const PyVar& obj, int depth){
+            if(depth > 64) return false;
+            if(obj == vm->None) return true;
+            if(obj->is_type(vm->tp_tuple)){
+                const pkpy::Tuple& t = vm->PyTuple_AS_C(obj);
+                for(int i=0; i<t.size(); i++) if(!_transferable(t[i], depth+1)) return false;
+                return true;
+            }
+            if(obj->is_type(vm->tp_list)){
+                for(const PyVar& x : vm->PyList_AS_C(obj)) if(!_transferable(x, depth+1)) return false;
+                return true;
+            }
+            for(Type t : {vm->tp_bool, vm->tp_int, vm->tp_float, vm->tp_str, vm->tp_bytes, vm->tp_function, vm->tp_module}){
+                if(obj->is_type(t)) return true;
+            }
+            return builtin_name(obj) != nullptr;
+        }
+
+        Message _value(const Function& fn, const char* what, StrName name, const PyVar& obj){
+            if(!_transferable(obj, 0)){
+                vm->TypeError("cannot send function " + fn.name.str().escape(true) + ": its " + what + " " +
+                    name.str().escape(true) + " is a " + OBJ_NAME(vm->_t(obj)).escape(true) + " object");
+            }
+            return Message::from(vm, obj, 0, this);
+        }
+
+    public:
+        _Shipper(VM* vm) : vm(vm) {}
+
+        // the name `obj` has in builtins, which every VM shares
+        const StrName* builtin_name(const PyVar& obj){
+            for(auto& [k, v] : vm->builtins->attr()){
+                if(v == obj) return &k;
+            }
+            return nullptr;
+        }
+
+        std::shared_ptr<const _FuncBlob> function(const Function& fn, bool with_globals){
+            auto blob = std::make_shared<_FuncBlob>();
+            blob->name = fn.name;
+            blob->code = _code(fn.code);
+            blob->args = fn.args;
+            blob->starred_arg = fn.starred_arg;
+            for(StrName k : fn.kwargs_order){
+                blob->kwargs.emplace_back(k, _value(fn, "default", k, fn.kwargs.at(k)));
+            }
+            std::vector<StrName> names;
+            _collect_names(fn.code, names);
+            if(fn._closure != nullptr){
+                blob->has_closure = true;
+                std::set<StrName> seen;
+                for(StrName n : names){
+                    PyVar* v = fn._closure->try_get(n);
+                    if(v == nullptr || !seen.insert(n).second) continue;
+                    blob->closure.emplace_back(n, _value(fn, "closure variable", n, *v));
+                }
+            }
+            if(!with_globals || fn._module == nullptr) return blob;
+            // globals used by this function and, transitively, by the functions of its module it uses
+            std::set<StrName> seen;
+            while(!names.empty()){
+                StrName n = names.back();
+                names.pop_back();
+                if(!seen.insert(n).second) continue;
+                PyVar* v = fn._module->attr().try_get(n);
+                if(v == nullptr) continue;
+                if((*v)->is_type(vm->tp_function)){
+                    const Function& g = vm->PyFunction_AS_C(*v);
+                    if(g._module == fn._module) _collect_names(g.code, names);
+                }
+                blob->globals.emplace_back(n, _value(fn, "global", n, *v));
+            }
+            return blob;
+        }
+    };
+
+    // rebuilds shipped functions in another VM, sharing one fresh module for their globals
+    class _Unshipper {
+        VM* vm;
+        PyVar _module;
+        std::map<const _SourceBlob*, pkpy::shared_ptr<SourceData>> _sources;
+        std::map<const _CodeBlob*, CodeObject_> _codes;
+
+        pkpy::shared_ptr<SourceData> _source(const std::shared_ptr<const _SourceBlob>& blob){
+            auto& src = _sources[blob.get()];
+            if(src == nullptr){
+                src = pkpy::make_shared<SourceData>(blob->source.c_str(), blob->filename, blob->mode);
+                for(const char* p = src->source; *p; p++){
+                    if(*p == '\n') src->line_starts.push_back(p + 1);
+                }
+            }
+            return src;
+        }
+
+        CodeObject_ _code(const std::shared_ptr<const _CodeBlob>& blob){
+            auto it = _codes.find(blob.get());
+            if(it != _codes.end()) return it->second;
+            CodeObject_ co = pkpy::make_shared<CodeObject>(_source(blob->src), blob->name);
+            co->is_generator = blob->is_generator;
+            co->is_coroutine = blob->is_coroutine;
+            co->codes = blob->codes;
+            for(const Message& c : blob->consts) co->consts.push_back(c.to(vm, this));
+            co->names = blob->names;
+            co->global_names = blob->global_names;
+            co->blocks = blob->blocks;
+            co->labels = blob->labels;
+            _codes[blob.get()] = co;
+            return co;
+        }
+
+    public:
+        _Unshipper(VM* vm) : vm(vm) {
+            _module = vm->new_object(vm->tp_module, DUMMY_VAL);
+            vm->setattr(_module, __name__, vm->PyStr("__main__"));
+        }
+
+        PyVar function(const _FuncBlob& blob, bool with_globals){
+            if(with_globals){
+                for(auto& [k, m] : blob.globals) _module->attr()[k] = m.to(vm, this);
+            }
+            Function fn;
+            fn.name = blob.name;
+            fn.code = _code(blob.code);
+            fn.args = blob.args;
+            fn.starred_arg = blob.starred_arg;
+            for(auto& [k, m] : blob.kwargs){
+                fn.kwargs[k] = m.to(vm, this);
+                fn.kwargs_order.push_back(k);
+            }
+            fn._module = _module;
+            if(blob.has_closure){
+                fn._closure = pkpy::make_shared<pkpy::NameDict>();
+                for(auto& [k, m] : blob.closure) (*fn._closure)[k] = m.to(vm, this);
+            }
+            return vm->PyFunction(fn);
+        }
+    };
+
+    Message Message::from(VM* vm, const PyVar& obj, int depth, _Shipper* shipper){
+        if(depth > 64) vm->ValueError("message is nested too deeply");
+        Message m;
+        if(obj == vm->None) return m;
+        if(obj->is_type(vm->tp_bool)){
+            m.kind = BOOL;
+            m.i = vm->PyBool_AS_C(obj);
+        }else if(obj->is_type(vm->tp_int)){
+            m.kind = INT;
+            m.i = vm->PyInt_AS_C(obj);
+        }else if(obj->is_type(vm->tp_float)){
+            m.kind = FLOAT;
+            m.f = vm->PyFloat_AS_C(obj);
+        }else if(obj->is_type(vm->tp_str)){
+            m.kind = STR;
+            m.s = vm->PyStr_AS_C(obj);
+        }else if(obj->is_type(vm->tp_bytes)){
+            m.kind = BYTES;
+            m.s = vm->PyBytes_AS_C(obj);
+        }else if(obj->is_type(vm->tp_tuple) || obj->is_type(vm->tp_list)){
+            bool is_tuple = obj->is_type(vm->tp_tuple);
+            m.kind = is_tuple ? TUPLE : LIST;
+            if(is_tuple){
+                const pkpy::Tuple& t = vm->PyTuple_AS_C(obj);
+                for(int i=0; i<t.size(); i++) m.items.push_back(from(vm, t[i], depth+1, shipper));
+            }else{
+                for(const PyVar& x : vm->PyList_AS_C(obj)) m.items.push_back(from(vm, x, depth+1, shipper));
+            }
+        }else if(obj->is_type(vm->tp_function)){
+            // the outermost function carries the globals; the ones it reaches share them
+            m.kind = FUNCTION;
+            if(shipper != nullptr){
+                m.func = shipper->function(vm->PyFunction_AS_C(obj), false);
+            }else{
+                _Shipper local(vm);
+                m.func = local.function(vm->PyFunction_AS_C(obj), true);
+            }
+        }else if(obj->is_type(vm->tp_module)){
+            m.kind = MODULE;
+            m.s = OBJ_NAME(obj);
+        }else{
+            _Shipper local(vm);
+            const StrName* name = local.builtin_name(obj);
+            if(name == nullptr) vm->TypeError("cannot send " + OBJ_NAME(vm->_t(obj)).escape(true) + " object to another vm");
+            m.kind = BUILTIN;
+            m.s = name->str();
+        }
+        return m;
+    }
+
+    PyVar Message::to(VM* vm, _Unshipper* unshipper) const {
+        switch(kind){
+            case NONE: return vm->None;
+            case BOOL: return vm->PyBool(i != 0);
+            case INT: return vm->PyInt(i);
+            case FLOAT: return vm->PyFloat(f);
+            case STR: return vm->PyStr(s);
+            case BYTES: return vm->PyBytes(s);
+            case TUPLE: case LIST: {
+                pkpy::List list(items.size());
+                for(int i=0; i<items.size(); i++) list[i] = items[i].to(vm, unshipper);
+                if(kind == LIST) return vm->PyList(std::move(list));
+                return vm->PyTuple(std::move(list));
+            }
+            case FUNCTION: {
+                if(unshipper != nullptr) return unshipper->function(*func, false);
+                _Unshipper local(vm);
+                return local.function(*func, true);
+            }
+            case MODULE: return vm->import_module(s);
+            case BUILTIN: return vm->builtins->attr(s);
+        }
+        UNREACHABLE();
+    }
+
+    // spins, then yields, then sleeps while waiting on a channel
+    struct _Backoff {
+        int n = 0;
+        void operator()(){
+            if(n < 64){ n++; return; }
+            if(n < 128){ n++; std::this_thread::yield(); return; }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    };
+
+    // bounded lock-free multi-producer multi-consumer queue (Vyukov)
+    template<typename T>
+    class Channel {
+        struct Cell {
+            std::atomic<size_t> seq;
+            T value;
+        };
+        std::unique_ptr<Cell[]> _cells;
+        size_t _mask;
+        alignas(64) std::atomic<size_t> _enqueue_pos{0};
+        alignas(64) std::atomic<size_t> _dequeue_pos{0};
+    public:
+        Channel(size_t capacity){
+            size_t n = 2;
+            while(n < capacity) n <<= 1;
+            _cells.reset(new Cell[n]);
+            _mask = n - 1;
+            for(size_t i=0; i<n; i++) _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        bool try_push(T& value){
+            size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+            while(true){
+                Cell& cell = _cells[pos & _mask];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if(diff == 0){
+                    if(_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                        cell.value = std::move(value);
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }else if(diff < 0){
+                    return false;       // full
+                }else{
+                    pos = _enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool try_pop(T& value){
+            size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+            while(true){
+                Cell& cell = _cells[pos & _mask];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+                if(diff == 0){
+                    if(_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                        value = std::move(cell.value);
+                        cell.value = T();
+                        cell.seq.store(pos + _mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }else if(diff < 0){
+                    return false;       // empty
+                }else{
+                    pos = _dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // block until done or `stop` becomes true; return false if stopped
+        bool push(T& value, const std::atomic<bool>& stop){
+            _Backoff backoff;
+            while(!try_push(value)){
+                if(stop.load(std::memory_order_relaxed)) return false;
+                backoff();
+            }
+            return true;
+        }
+
+        bool pop(T& value, const std::atomic<bool>& stop){
+            _Backoff backoff;
+            while(!try_pop(value)){
+                if(stop.load(std::memory_order_relaxed)) return false;
+                backoff();
+            }
+            return true;
+        }
+    };
+
+#ifdef PK_USE_THREADS
+    // id of the actor running on this thread; 0 is the host
+    static thread_local i64 _actor_id = 0;
+
+    // N threads, each owning one VM, running actor scripts.
+    // Every actor has a mailbox; actors only share `Message`s, never objects.
+    class WorkerPool {
+        struct Job {
+            i64 id = 0;
+            std::function<void(VM*)> fn;
+        };
+
+        struct Mailbox {
+            Channel<Message> channel;
+            std::atomic<bool> closed{false};    // the actor finished or the pool stopped
+            Mailbox() : channel(kMailboxSize) {}
+        };
+
+        // an actor id is its slot in the low 32 bits and the slot's generation above them,
+        // so a slot is reused once its actor finishes and stale ids don't reach the new owner
+        struct Slot {
+            i64 generation = 0;
+            bool live = false;
+            std::shared_ptr<Mailbox> box;       // allocated on first use
+        };
+
+        static constexpr int kMailboxSize = 1024;
+        static constexpr int kSlotBits = 32;
+
+        std::function<VM*()> _new_vm;
+        std::function<void(VM*)> _delete_vm;
+        Channel<Job> _jobs;
+        std::vector<std::thread> _threads;
+        std::mutex _mailbox_mutex;
+        std::vector<Slot> _slots;
+        std::vector<int> _free_slots;
+        std::vector<VM*> _vms;
+        std::atomic<bool> _stop{false};
+        std::atomic<int> _running{0};
+
+        static int _slot_of(i64 id){ return (int)(id & ((i64(1) << kSlotBits) - 1)); }
+
+        void _release(i64 id){
+            std::lock_guard<std::mutex> lock(_mailbox_mutex);
+            Slot& slot = _slots[_slot_of(id)];
+            if(slot.box != nullptr) slot.box->closed = true;
+            slot.box = nullptr;
+            slot.live = false;
+            slot.generation++;
+            _free_slots.push_back(_slot_of(id));
+        }
+
+        void _worker(){
+            VM* vm = _new_vm();
+            {
+                std::lock_guard<std::mutex> lock(_mailbox_mutex);
+                _vms.push_back(vm);
+            }
+            Job job;
+            while(_jobs.pop(job, _stop)){
+                if(!_stop){
+                    _actor_id = job.id;
+                    pkpy::_HeapScope heap_scope(vm->heap.get());
+                    job.fn(vm);
+                    _actor_id = 0;
+                }
+                job.fn = nullptr;
+                if(job.id > 0) _release(job.id);
+                _running--;
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mailbox_mutex);
+                _vms.erase(std::find(_vms.begin(), _vms.end(), vm));
+            }
+            _delete_vm(vm);
+        }
+
+    public:
+        WorkerPool(int n, std::function<VM*()> new_vm, std::function<void(VM*)> delete_vm)
+            : _new_vm(new_vm), _delete_vm(delete_vm), _jobs(256) {
+            _slots.emplace_back();      // the host
+            _slots[0].live = true;
+            for(int i=0; i<n; i++) _threads.emplace_back(&WorkerPool::_worker, this);
+        }
+
+        // wake actors blocked on a mailbox and interrupt running ones, or joining could hang
+        ~WorkerPool(){
+            {
+                std::lock_guard<std::mutex> lock(_mailbox_mutex);
+                _stop = true;
+                for(Slot& slot : _slots) if(slot.box != nullptr) slot.box->closed = true;
+                for(VM* vm : _vms) vm->interrupt();
+            }
+            for(auto& t : _threads) t.join();
+        }
+
+        inline int size() const { return (int)_threads.size(); }
+        inline int running() const { return _running.load(); }
+        inline bool stopped() const { return _stop.load(); }
+
+        // queue a script as a new actor and return its id
+        // an actor blocked in recv() keeps its worker busy, so at most size() actors wait at once
+        i64 spawn(std::string source){
+            Job job;
+            {
+                std::lock_guard<std::mutex> lock(_mailbox_mutex);
+                int index;
+                if(_free_slots.empty()){
+                    index = (int)_slots.size();
+                    _slots.emplace_back();
+                }else{
+                    index = _free_slots.back();
+                    _free_slots.pop_back();
+                }
+                _slots[index].live = true;
+                job.id = (_slots[index].generation << kSlotBits) | index;
+            }
+            Str filename = "<actor " + std::to_string(job.id) + ">";
+            job.fn = [source=std::move(source), filename](VM* vm){
+                PyVar mod = vm->new_object(vm->tp_module, DUMMY_VAL);
+                vm->setattr(mod, __name__, vm->PyStr("__main__"));
+                vm->exec(source, filename, EXEC_MODE, mod);
+            };
+            _running++;
+            i64 id = job.id;
+            if(!_jobs.push(job, _stop)){
+                _release(id);
+                _running--;
+            }
+            return id;
+        }
+
+        // queue a task with no mailbox; it must not throw
+        bool submit(std::function<void(VM*)> fn){
+            Job job;
+            job.id = -1;
+            job.fn = std::move(fn);
+            _running++;
+            if(_jobs.push(job, _stop)) return true;
+            _running--;
+            return false;
+        }
+
+        // nullptr if `id` is not a live actor
+        std::shared_ptr<Mailbox> mailbox(i64 id){
+            std::lock_guard<std::mutex> lock(_mailbox_mutex);
+            if(id < 0 || _stop) return nullptr;
+            int index = _slot_of(id);
+            if(index >= (int)_slots.size()) return nullptr;
+            Slot& slot = _slots[index];
+            if(!slot.live || (id >> kSlotBits) != slot.generation) return nullptr;
+            if(slot.box == nullptr) slot.box = std::make_shared<Mailbox>();
+            return slot.box;
+        }
+
+        // false if the actor is gone or the pool stopped
+        bool send(i64 id, Message& msg){
+            std::shared_ptr<Mailbox> box = mailbox(id);
+            return box != nullptr && box->channel.push(msg, box->closed);
+        }
+
+        bool recv(i64 id, Message& msg){
+            std::shared_ptr<Mailbox> box = mailbox(id);
+            return box != nullptr && box->channel.pop(msg, box->closed);
+        }
+    };
+
+    // shared by the caller of parallel.map and its pool tasks.
+    // Everyone claims fixed-size chunks from one cursor, so faster workers take more of them.
+    struct ParallelMap {
+        Message fn;
+        std::vector<Message> items;
+        std::vector<Message> results;
+        std::vector<uint8_t> remote;        // results[i] was computed by a pool task
+        int chunk_size = 1;
+        int n_chunks = 0;
+        std::atomic<int> next_chunk{0};
+        std::atomic<int> active{0};
+        std::atomic<bool> closed{false};
+        std::atomic<bool> failed{false};
+        std::mutex error_mutex;
+        Str error_type;
+        Str error_msg;
+
+        bool claim(int& begin, int& end){
+            if(failed.load()) return false;
+            int c = next_chunk++;
+            if(c >= n_chunks) return false;
+            begin = c * chunk_size;
+            end = std::min(begin + chunk_size, (int)items.size());
+            return true;
+        }
+
+        void fail(const Str& type, const Str& msg){
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(failed.load()) return;
+            error_type = type;
+            error_msg = msg;
+            failed = true;
+        }
+
+        // body of a pool task
+        void work(VM* vm){
+            active++;
+            if(closed.load()){ active--; return; }
+            try{
+                PyVar f = fn.to(vm);
+                int begin, end;
+                while(claim(begin, end)){
+                    for(int i=begin; i<end; i++){
+                        results[i] = Message::from(vm, vm->call(f, pkpy::one_arg(items[i].to(vm))));
+                        remote[i] = 1;
+                    }
+                }
+            }catch(const pkpy::Exception& e){
+                fail(e.type_name(), e.message());
+                vm->callstack = {};
+            }catch(const std::exception& e){
+                fail("RuntimeError", e.what());
+                vm->callstack = {};
+            }
+            active--;
+        }
+
+        // stop new tasks from joining and wait for the running ones
+        void close(){
+            closed = true;
+            _Backoff backoff;
+            while(active.load() > 0) backoff();
+        }
+    };
+#endif
+}
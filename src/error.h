@@ -74,7 +74,10 @@ class Exception {
 public:
     Exception(Str type, Str msg): type(type), msg(msg) {}
     bool match_type(const Str& type) const { return this->type == type;}
+    const Str& type_name() const { return type; }
+    const Str& message() const { return msg; }
     bool is_re = true;
+    bool is_fatal = false;      // skips every handler and ends the run
 
     void st_push(Str snapshot){
         if(stacktrace.size() >= 8) return;
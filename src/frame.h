@@ -13,13 +13,14 @@ struct Frame {
     PyVar _module;
     pkpy::shared_ptr<pkpy::NameDict> _locals;
     pkpy::shared_ptr<pkpy::NameDict> _closure;
-    const i64 id;
+    i64 id;
     std::stack<std::pair<int, std::vector<PyVar>>> s_try_block;
+    bool _throw_on_resume = false;      // the value pushed on resume is an exception to raise at the `await`
 
     inline pkpy::NameDict& f_locals() noexcept { return *_locals; }
     inline pkpy::NameDict& f_globals() noexcept { return _module->attr(); }
 
-    inline PyVar* f_closure_try_get(const Str& name) noexcept {
+    inline PyVar* f_closure_try_get(StrName name) noexcept {
         if(_closure == nullptr) return nullptr;
         return _closure->try_get(name);
     }
@@ -28,6 +29,9 @@ struct Frame {
         pkpy::shared_ptr<pkpy::NameDict> _locals, pkpy::shared_ptr<pkpy::NameDict> _closure=nullptr)
         : co(co), _module(_module), _locals(_locals), _closure(_closure), id(kFrameGlobalId++) { }
 
+    // a suspended frame is resumed above its new caller
+    inline void renew_id(){ id = kFrameGlobalId++; }
+
     inline const Bytecode& next_bytecode() {
         _ip = _next_ip++;
         return co->codes[_ip];
@@ -79,6 +83,13 @@ struct Frame {
         return value;
     }
 
+    // borrow the value on top instead of copying it; a reference there is replaced by its value
+    inline const PyVar& top_value_borrowed(VM* vm){
+        PyVar& value = top();
+        try_deref(vm, value);
+        return value;
+    }
+
     inline PyVar& top(){
         if(_data.empty()) throw std::runtime_error("_data.empty() is true");
         return _data.back();
@@ -121,6 +132,11 @@ struct Frame {
         return co->blocks[i].parent;
     }
 
+    bool _is_enclosing_block(int i, int j) const {
+        while(j>=0 && j!=i) j = co->blocks[j].parent;
+        return j == i;
+    }
+
     void jump_abs_safe(int target){
         const Bytecode& prev = co->codes[_ip];
         int i = prev.block;
@@ -128,9 +144,10 @@ struct Frame {
         if(_next_ip >= co->codes.size()){
             while(i>=0) i = _exit_block(i);
         }else{
+            // the target may open a nested block, e.g. a `try` right after a loop
             const Bytecode& next = co->codes[target];
-            while(i>=0 && i!=next.block) i = _exit_block(i);
-            if(i!=next.block) throw std::runtime_error("invalid jump");
+            while(i>=0 && !_is_enclosing_block(i, next.block)) i = _exit_block(i);
+            if(i<0) throw std::runtime_error("invalid jump");
         }
     }
 
@@ -57,6 +57,7 @@ public:
 
     PyVar next() {
         if(state == 2) return nullptr;
+        frame->renew_id();
         vm->callstack.push(std::move(frame));
         PyVar ret = vm->_exec();
         if(ret == vm->_py_op_yield){
@@ -69,4 +70,60 @@ public:
             return nullptr;
         }
     }
-};
\ No newline at end of file
+};
+
+// the suspended frame of an `async def` call, driven by the asyncio event loop
+struct Coroutine {
+    PY_CLASS(builtins, coroutine)
+
+    std::unique_ptr<Frame> frame;
+    int state = 0;  // 0,1,2
+
+    Coroutine(std::unique_ptr<Frame>&& frame) : frame(std::move(frame)) {}
+
+    inline bool started() const { return state != 0; }
+    inline bool finished() const { return state == 2; }
+
+    // run until the next `await` and return its operand, or return nullptr once finished with `ret`.
+    // `value` becomes the result of the pending `await`, or is raised there if `thrown`
+    PyVar resume(VM* vm, const PyVar& value, PyVar& ret, bool thrown=false){
+        if(state == 2) vm->RuntimeError("cannot reuse already awaited coroutine");
+        if(state == 0 && thrown){
+            state = 2;
+            vm->_error(vm->PyException_AS_C(value));
+        }
+        if(state == 1){
+            frame->push(value);
+            frame->_throw_on_resume = thrown;
+        }
+        state = 2;      // stays finished if an exception escapes
+        frame->renew_id();
+        vm->callstack.push(std::move(frame));
+        PyVar r = vm->_exec();
+        if(r == vm->_py_op_yield){
+            frame = std::move(vm->callstack.top());
+            vm->callstack.pop();
+            state = 1;
+            return frame->pop_value(vm);
+        }
+        ret = r;
+        return nullptr;
+    }
+
+    static void _register(VM* vm, PyVar mod, PyVar type){
+        vm->bind_method<-1>(type, "__init__", [](VM* vm, pkpy::Args& args) {
+            vm->NotImplementedError();
+            return vm->None;
+        });
+
+        vm->bind_method<0>(type, "__repr__", [](VM* vm, pkpy::Args& args) {
+            Coroutine& self = vm->py_cast<Coroutine>(args[0]);
+            if(self.frame == nullptr) return vm->PyStr("<coroutine>");
+            return vm->PyStr("<coroutine " + self.frame->co->name.escape(true) + ">");
+        });
+    }
+};
+
+PyVar VM::_new_coroutine(std::unique_ptr<Frame>&& frame){
+    return new_object<Coroutine>(std::move(frame));
+}
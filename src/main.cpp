@@ -7,6 +7,7 @@ int main(int argc, char** argv){
     VM* vm = pkpy_new_vm(true);
     vm->bind_builtin_func<0>("input", [](VM* vm, pkpy::Args& args){
         static std::string line;
+        vm->flush_output();
         std::getline(std::cin, line);
         return vm->PyStr(line);
     });
@@ -15,6 +16,7 @@ int main(int argc, char** argv){
         bool need_more_lines = false;
         while(true){
             (*vm->_stdout) << (need_more_lines ? "... " : ">>> ");
+            vm->flush_output();
             std::string line;
             if (!std::getline(std::cin, line)) break;
             need_more_lines = pkpy_repl_input(repl, line.c_str());
@@ -2,6 +2,8 @@
 
 #include "common.h"
 
+struct PyObject;        // destroyed through its kind table, not a virtual destructor
+
 namespace pkpy{
     template<typename T>
     struct SpAllocator {
@@ -16,13 +18,16 @@ namespace pkpy{
         }
     };
 
+    // a refcount from here up marks an immortal object: copies skip the count and it is never freed by them
+    constexpr int kImmortalRef = 1 << 30;
+
     template <typename T>
     class shared_ptr {
         int* counter;
 
 #define _t() ((T*)(counter + 1))
-#define _inc_counter() if(counter) ++(*counter)
-#define _dec_counter() if(counter && --(*counter) == 0){ SpAllocator<T>::dealloc(counter); }
+#define _inc_counter() if(counter && *counter < kImmortalRef) ++(*counter)
+#define _dec_counter() if(counter && *counter < kImmortalRef && --(*counter) == 0){ SpAllocator<T>::dealloc(counter); }
 
     public:
         shared_ptr() : counter(nullptr) {}
@@ -70,6 +75,10 @@ namespace pkpy{
         T* get() const { return _t(); }
         int use_count() const { return counter ? *counter : 0; }
 
+        // host handles may outlive the vm, so immortal objects are never freed
+        inline void make_immortal(){ if(counter) *counter = kImmortalRef; }
+        inline bool is_immortal() const { return counter && *counter >= kImmortalRef; }
+
         void reset(){
             _dec_counter();
             counter = nullptr;
@@ -83,7 +92,7 @@ namespace pkpy{
     template <typename T, typename U, typename... Args>
     shared_ptr<T> make_shared(Args&&... args) {
         static_assert(std::is_base_of_v<T, U>, "U must be derived from T");
-        static_assert(std::has_virtual_destructor_v<T>, "T must have virtual destructor");
+        static_assert(std::has_virtual_destructor_v<T> || std::is_same_v<T, PyObject>, "T must have virtual destructor");
         int* p = SpAllocator<T>::template alloc<U>(); *p = 1;
         new(p+1) U(std::forward<Args>(args)...);
         return shared_ptr<T>(p);
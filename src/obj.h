@@ -15,24 +15,26 @@ struct NativeFunc {
     NativeFuncRaw f;
     int argc;       // DONOT include self
     bool method;
+    // keyword arguments with defaults, passed to `f` after the positional ones
+    std::vector<std::pair<StrName, PyVar>> kwargs;
     
     NativeFunc(NativeFuncRaw f, int argc, bool method) : f(f), argc(argc), method(method) {}
-    inline PyVar operator()(VM* vm, pkpy::Args& args) const;
+    PyVar operator()(VM* vm, pkpy::Args& args, const pkpy::Args& kwargs) const;
 };
 
 struct Function {
-    Str name;
+    StrName name;
     CodeObject_ code;
-    std::vector<Str> args;
-    Str starred_arg;                // empty if no *arg
+    std::vector<StrName> args;
+    StrName starred_arg;            // empty if no *arg
     pkpy::NameDict kwargs;          // empty if no k=v
-    std::vector<Str> kwargs_order;
+    std::vector<StrName> kwargs_order;
 
     // runtime settings
     PyVar _module;
     pkpy::shared_ptr<pkpy::NameDict> _closure;
 
-    bool has_name(const Str& val) const {
+    bool has_name(StrName val) const {
         bool _0 = std::find(args.begin(), args.end(), val) != args.end();
         bool _1 = starred_arg == val;
         bool _2 = kwargs.find(val) != kwargs.end();
@@ -63,6 +65,83 @@ struct Slice {
         if(stop < start) stop = start;
     }
 };
+
+// the attribute names of an instance, in the order they were added;
+// instances that got the same names in the same order share one shape
+struct Shape {
+    static constexpr int kMaxSize = 32;             // instances with more attributes fall back to a dict
+    static constexpr int kMaxTransitions = 32;
+    static constexpr int kMaxShapes = 16384;        // per tree
+    inline static std::atomic<uint64_t> _next_id{1};
+
+    uint64_t id = _next_id++;                       // never reused, unlike addresses
+    std::vector<StrName> keys;
+    std::vector<std::pair<StrName, std::unique_ptr<Shape>>> transitions;
+    Shape* root = this;
+    int _n_shapes = 1;                              // only kept by the root
+
+    inline int size() const noexcept { return (int)keys.size(); }
+
+    inline int index_of(StrName name) const noexcept {
+        for(int i=0; i<size(); i++) if(keys[i] == name) return i;
+        return -1;
+    }
+
+    // the shape after adding `name`; nullptr for patterns that are better served by a dict
+    Shape* add(StrName name){
+        for(auto& [k, s] : transitions) if(k == name) return s.get();
+        if(size() >= kMaxSize || transitions.size() >= kMaxTransitions) return nullptr;
+        if(root->_n_shapes >= kMaxShapes) return nullptr;
+        root->_n_shapes++;
+        auto next = std::make_unique<Shape>();
+        next->keys = keys;
+        next->keys.push_back(name);
+        next->root = root;
+        transitions.emplace_back(name, std::move(next));
+        return transitions.back().second.get();
+    }
+
+    // slots allocated for `size` attributes, so most additions don't reallocate
+    static int capacity(int size) noexcept {
+        if(size == 0) return 0;
+        int cap = 2;
+        while(cap < size) cap <<= 1;
+        return cap;
+    }
+};
+
+// attribute values of an instance of a python class, indexed like the keys of its shape
+struct Instance {
+    PyVar* values = nullptr;
+
+    Instance() = default;
+    Instance(Instance&& other) noexcept : values(other.values) { other.values = nullptr; }
+    Instance(const Instance&) = delete;
+    ~Instance(){ delete[] values; }
+};
+
+// the values of an instance of a class with __slots__, kept inside the object;
+// `values` comes first so the object also reads as an Instance
+template<int N>
+struct FixedInstance {
+    PyVar* values = _inline;
+    PyVar _inline[N];
+
+    FixedInstance() = default;
+    FixedInstance(FixedInstance&&) noexcept {}      // only ever moved from an empty one
+    FixedInstance(const FixedInstance&) = delete;
+};
+
+constexpr int kMaxInlineSlots = 8;      // larger fixed layouts keep their values in an Instance
+
+template<typename T> constexpr bool _is_fixed_instance = false;
+template<int N> constexpr bool _is_fixed_instance<FixedInstance<N>> = true;
+
+// the shape last seen by one attribute load and where it keeps the attribute
+struct _AttrCache {
+    uint64_t shape_id = 0;
+    int index = 0;
+};
 }
 
 class BaseIter {
@@ -76,41 +155,269 @@ public:
     virtual ~BaseIter() = default;
 };
 
+namespace pkpy {
+    // bytes held by the objects of one vm; shared with the C API handles that may outlive it
+    struct Heap : std::enable_shared_from_this<Heap> {
+        i64 allocated = 0;
+        i64 limit = -1;                 // -1 for no limit
+        i64 _threshold = INT64_MAX;     // the limit, raised a little after a MemoryError so handlers can clean up
+        i64* _ticks = nullptr;          // zeroed when over the threshold, so the next preemption point raises
+
+        inline void charge(i64 bytes) noexcept {
+            allocated += bytes;
+            if(allocated > _threshold && _ticks != nullptr) *_ticks = 0;
+        }
+
+        // after a MemoryError, the limit is back once usage is down to half of it
+        inline void _recover() noexcept {
+            if(_threshold > limit && allocated <= limit / 2) _threshold = limit;
+        }
+
+        void set_limit(i64 bytes){
+            limit = bytes < 0 ? -1 : bytes;
+            _threshold = bytes < 0 ? INT64_MAX : bytes;
+        }
+    };
+
+    // objects are charged to the heap current on their thread when created, and credited to it when freed.
+    // It is only set inside a `_HeapScope`, so it never outlives the vm running on the thread
+    static THREAD_LOCAL Heap* _heap = nullptr;
+
+    // make `heap` current for a scope
+    struct _HeapScope {
+        Heap* prev;
+        _HeapScope(Heap* heap) : prev(_heap) { _heap = heap; }
+        ~_HeapScope(){ _heap = prev; }
+        _HeapScope(const _HeapScope&) = delete;
+        _HeapScope& operator=(const _HeapScope&) = delete;
+    };
+}
+
+struct PyObject;
+
+namespace pkpy {
+    // how to measure and destroy the value of objects holding one C++ type; shared by all vms
+    struct _Kind {
+        int size;                               // bytes of the object, its refcount included
+        void (*destroy)(PyObject*);             // runs the destructor of the value
+        i64 (*payload)(const PyObject*);        // bytes owned outside the object
+    };
+
+    constexpr int kMaxKinds = 1024;
+    inline _Kind _kinds[kMaxKinds];
+    inline std::atomic<int> _n_kinds{0};
+
+    inline uint16_t _register_kind(_Kind kind){
+        int id = _n_kinds++;
+        if(id >= kMaxKinds) throw std::runtime_error("too many object kinds");
+        _kinds[id] = kind;
+        return (uint16_t)id;
+    }
+
+    template<typename T> uint16_t _kind_of();
+}
+
+// With the refcount in front of it, `type` shares one 8-byte word with the count.
+// The value follows the header, after a pointer to the attribute dict for kinds that have one.
+// Instances of python classes keep a shape there instead, until they fall back to a dict.
 struct PyObject {
     Type type;
-    pkpy::NameDict* _attr;
-    // void* _tid;
-    const int _size;
+    uint16_t _kind;         // index into pkpy::_kinds
+    uint16_t _flags;
+    uint32_t _charged;      // 8-byte words charged to the heap, 0 if none
+
+    static constexpr uint16_t kHasAttr = 1;
+    static constexpr uint16_t kShaped = 2;      // the value is a pkpy::Instance
+    static constexpr uint16_t kFixed = 4;       // shaped by __slots__; no attribute can be added
+
+    inline bool is_attr_valid() const noexcept { return _flags & kHasAttr; }
+    inline bool _is_shaped() const noexcept { return _flags & kShaped; }
+    inline bool _is_fixed() const noexcept { return _flags & kFixed; }
+    inline pkpy::NameDict*& _attr_ptr() const noexcept { return *(pkpy::NameDict**)((char*)this + sizeof(PyObject)); }
+    inline pkpy::Shape*& _shape() const noexcept { return *(pkpy::Shape**)((char*)this + sizeof(PyObject)); }
+    inline pkpy::Instance& _instance() noexcept { return *(pkpy::Instance*)value(); }
 
-    inline bool is_attr_valid() const noexcept { return _attr != nullptr; }
-    inline pkpy::NameDict& attr() noexcept { return *_attr; }
-    inline PyVar& attr(const Str& name) noexcept { return (*_attr)[name]; }
+    // the attribute dict; a shaped instance is converted to one first.
+    // A fixed instance has none, and its slots live inline, so callers must check _is_fixed() first
+    inline pkpy::NameDict& attr() {
+        if(_is_shaped()){
+            if(_is_fixed()) UNREACHABLE();
+            _unshape();
+        }
+        return *_attr_ptr();
+    }
+    inline PyVar& attr(StrName name) { return attr()[name]; }
+
+    PyVar* attr_try_get(StrName name) noexcept;
+    PyVar* attr_try_get(StrName name, pkpy::_AttrCache& cache) noexcept;
+    std::vector<StrName> attr_keys();
+    PyVar* _shape_slot(StrName name);
+    void _unshape() noexcept;
 
     inline bool is_type(Type type) const noexcept{ return this->type == type; }
-    virtual void* value() = 0;
+    inline void* value() noexcept { return (char*)this + sizeof(PyObject) + (is_attr_valid() ? sizeof(void*) : 0); }
+
+    inline int _object_size() const noexcept { return pkpy::_kinds[_kind].size; }
+    // bytes owned outside the object, like the buffer of a str or a list
+    inline i64 _payload() const { return pkpy::_kinds[_kind].payload(this); }
+
+    // charge the current heap for a change in the size of the object
+    inline void _account(i64 payload) noexcept {
+        if(pkpy::_heap == nullptr) return;
+        i64 words = std::min<i64>((_object_size() + payload + 7) / 8, UINT32_MAX);
+        if(words == _charged) return;
+        pkpy::_heap->charge((words - (i64)_charged) * 8);
+        _charged = (uint32_t)words;
+    }
+    inline void _account() noexcept { _account(_payload()); }
+
+    PyObject(Type type, uint16_t kind, uint16_t flags) : type(type), _kind(kind), _flags(flags), _charged(0) {}
 
-    PyObject(Type type, const int size) : type(type), _size(size) {}
-    virtual ~PyObject() { delete _attr; }
+    // free what the header owns; the value is destroyed through the kind table
+    inline void _release() noexcept {
+        if(is_attr_valid() && !_is_shaped()) delete _attr_ptr();
+        if(_charged != 0 && pkpy::_heap != nullptr) pkpy::_heap->allocated -= (i64)_charged * 8;
+    }
 };
 
+static_assert(sizeof(PyObject) == 12);
+
 template <typename T>
 struct Py_ : PyObject {
-    T _value;
+    static_assert(alignof(T) <= 8, "the value is only 8-byte aligned");
+    static constexpr bool kFixedKind = pkpy::_is_fixed_instance<T>;
+    static constexpr bool kShapedKind = std::is_same_v<T, pkpy::Instance> || kFixedKind;
+    static constexpr bool kWithAttr = std::is_same_v<T, Dummy> || std::is_same_v<T, Type> || kShapedKind;
+    static constexpr int kValueOffset = kWithAttr ? sizeof(void*) : 0;
+    static constexpr uint16_t kFlags = kFixedKind ? (kHasAttr | kShaped | kFixed) :
+                                       kShapedKind ? (kHasAttr | kShaped) : kWithAttr ? kHasAttr : 0;
+
+    alignas(4) char _storage[kValueOffset + sizeof(T)];
 
-    Py_(Type type, const T& val): PyObject(type, sizeof(Py_<T>)), _value(val) { _init(); }
-    Py_(Type type, T&& val): PyObject(type, sizeof(Py_<T>)), _value(std::move(val)) { _init(); }
+    Py_(Type type, const T& val): PyObject(type, pkpy::_kind_of<T>(), kFlags) {
+        new(_storage + kValueOffset) T(val);
+        _init();
+    }
+    Py_(Type type, T&& val): PyObject(type, pkpy::_kind_of<T>(), kFlags) {
+        new(_storage + kValueOffset) T(std::move(val));
+        _init();
+    }
 
     inline void _init() noexcept {
-        if constexpr (std::is_same_v<T, Dummy> || std::is_same_v<T, Type>) {
-            _attr = new pkpy::NameDict();
-        }else{
-            _attr = nullptr;
+        if constexpr (kShapedKind) _shape() = nullptr;      // no attributes yet
+        else if constexpr (kWithAttr) _attr_ptr() = new pkpy::NameDict();
+        _account(_payload_of(this));
+    }
+
+    inline T& _value() noexcept { return *(T*)(_storage + kValueOffset); }
+    inline const T& _value() const noexcept { return *(const T*)(_storage + kValueOffset); }
+
+    static void _destroy(PyObject* obj){ ((Py_<T>*)obj)->_value().~T(); }
+
+    static i64 _payload_of(const PyObject* obj){
+        const T& value = ((const Py_<T>*)obj)->_value();
+        i64 bytes = 0;
+        if constexpr (std::is_base_of_v<std::string, T>) {
+            if(value.capacity() > 15) bytes = value.capacity() + 1;     // beyond the small string buffer
+        }else if constexpr (std::is_same_v<T, pkpy::List>) {
+            bytes = value.capacity() * sizeof(PyVar);
+        }else if constexpr (std::is_same_v<T, pkpy::Args>) {
+            bytes = value.size() * sizeof(PyVar);
+        }
+        if(obj->_is_shaped()){
+            if constexpr (kFixedKind) return bytes;     // the values are inside the object
+            const pkpy::Shape* shape = obj->_shape();
+            if(shape == nullptr) return bytes;      // still being constructed
+            bytes += (obj->_is_fixed() ? shape->size() : pkpy::Shape::capacity(shape->size())) * sizeof(PyVar);
+        }else if(obj->is_attr_valid()){
+            bytes += sizeof(pkpy::NameDict) + obj->_attr_ptr()->bucket_count() * (sizeof(std::pair<StrName, PyVar>) + 8);
         }
+        return bytes;
     }
-    void* value() override { return &_value; }
 };
 
-#define OBJ_GET(T, obj) (((Py_<T>*)((obj).get()))->_value)
+template<typename T>
+uint16_t pkpy::_kind_of(){
+    static const uint16_t id = _register_kind(_Kind{(int)(sizeof(int) + sizeof(Py_<T>)), &Py_<T>::_destroy, &Py_<T>::_payload_of});
+    return id;
+}
+
+inline PyVar* PyObject::attr_try_get(StrName name) noexcept {
+    if(!_is_shaped()) return _attr_ptr()->try_get(name);
+    int i = _shape()->index_of(name);
+    if(i < 0) return nullptr;
+    PyVar* val = &_instance().values[i];
+    return *val != nullptr ? val : nullptr;     // an unset slot
+}
+
+inline PyVar* PyObject::attr_try_get(StrName name, pkpy::_AttrCache& cache) noexcept {
+    if(!_is_shaped()) return _attr_ptr()->try_get(name);
+    const pkpy::Shape* shape = _shape();
+    if(shape->id != cache.shape_id){
+        int i = shape->index_of(name);
+        if(i < 0) return nullptr;
+        cache.shape_id = shape->id;
+        cache.index = i;
+    }
+    PyVar* val = &_instance().values[cache.index];
+    return *val != nullptr ? val : nullptr;
+}
+
+inline std::vector<StrName> PyObject::attr_keys(){
+    std::vector<StrName> keys;
+    if(_is_shaped()){
+        const pkpy::Shape* shape = _shape();
+        for(int i=0; i<shape->size(); i++){
+            if(_instance().values[i] != nullptr) keys.push_back(shape->keys[i]);
+        }
+        return keys;
+    }
+    for(auto& [k, _] : *_attr_ptr()) keys.push_back(k);
+    return keys;
+}
+
+// the slot of an attribute of a shaped instance, added if missing;
+// nullptr if it fell back to a dict, or if a fixed instance has no such slot
+inline PyVar* PyObject::_shape_slot(StrName name){
+    pkpy::Shape* shape = _shape();
+    pkpy::Instance& inst = _instance();
+    int i = shape->index_of(name);
+    if(i >= 0) return &inst.values[i];
+    if(_is_fixed()) return nullptr;
+    int size = shape->size();
+    pkpy::Shape* next = shape->add(name);
+    if(next == nullptr){
+        _unshape();
+        return nullptr;
+    }
+    int cap = pkpy::Shape::capacity(size + 1);
+    if(cap != pkpy::Shape::capacity(size)){
+        PyVar* values = new PyVar[cap];
+        for(int j=0; j<size; j++) values[j] = std::move(inst.values[j]);
+        delete[] inst.values;
+        inst.values = values;
+        _shape() = next;
+        _account();
+    }else{
+        _shape() = next;
+    }
+    return &inst.values[size];
+}
+
+// deletions and unusual patterns leave the instance with a dict for good
+inline void PyObject::_unshape() noexcept {
+    pkpy::Shape* shape = _shape();
+    pkpy::Instance& inst = _instance();
+    pkpy::NameDict* dict = new pkpy::NameDict();
+    for(int i=0; i<shape->size(); i++) (*dict)[shape->keys[i]] = std::move(inst.values[i]);
+    delete[] inst.values;
+    inst.values = nullptr;
+    _flags &= ~kShaped;
+    _attr_ptr() = dict;
+    _account();
+}
+
+#define OBJ_GET(T, obj) (((Py_<T>*)((obj).get()))->_value())
 #define OBJ_NAME(obj) OBJ_GET(Str, (obj)->attr(__name__))
 
 #define PY_CLASS(mod, name) \
@@ -123,6 +430,7 @@ namespace pkpy {
     template<int N>
     struct MemBlock {
         std::vector<void*> a;
+        std::vector<void*> blocks;
         int block_size;
 
         MemBlock(int block_size) : block_size(block_size) {
@@ -131,6 +439,7 @@ namespace pkpy {
 
         void new_block(){
             int8_t* total = (int8_t*)malloc(N * block_size);
+            blocks.push_back(total);
             for(int i = 0; i < block_size; ++i){
                 a.push_back((void*)(total + i * N));
             }
@@ -148,18 +457,19 @@ namespace pkpy {
         }
 
         ~MemBlock(){
-            free(a[0]);
+            for(void* p : blocks) free(p);
         }
     };
 
     constexpr int kMemObjSize = sizeof(int) + sizeof(Py_<i64>);
+    static_assert(kMemObjSize % 8 == 0, "pooled objects must stay 8-byte aligned");
     static THREAD_LOCAL MemBlock<kMemObjSize> _mem_pool(512);
 
     template<>
     struct SpAllocator<PyObject> {
         template<typename U>
         inline static int* alloc(){
-            if constexpr (sizeof(int) + sizeof(U) == kMemObjSize) {
+            if constexpr (sizeof(int) + sizeof(U) <= kMemObjSize) {
                 return (int*)_mem_pool.alloc();
             }
             return (int*)malloc(sizeof(int) + sizeof(U));
@@ -167,8 +477,10 @@ namespace pkpy {
 
         inline static void dealloc(int* counter){
             PyObject* obj = (PyObject*)(counter + 1);
-            obj->~PyObject();
-            if(obj->_size == kMemObjSize - sizeof(int)){
+            const _Kind& kind = _kinds[obj->_kind];
+            kind.destroy(obj);
+            obj->_release();
+            if(kind.size <= kMemObjSize){
                 _mem_pool.dealloc(counter);
             }else{
                 free(counter);
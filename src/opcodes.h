@@ -69,6 +69,8 @@ OPCODE(TRY_BLOCK_ENTER)
 OPCODE(TRY_BLOCK_EXIT)
 
 OPCODE(YIELD_VALUE)
+OPCODE(AWAIT)           // suspend a coroutine on the awaitable at top
+OPCODE(AWAIT_RESULT)    // raise it if the coroutine was resumed with an exception
 
 OPCODE(FAST_INDEX)      // a[x]
 OPCODE(FAST_INDEX_REF)       // a[x]
@@ -12,7 +12,7 @@ constexpr const char* kTokens[] = {
     "==", "!=", ">=", "<=",
     "+=", "-=", "*=", "/=", "//=", "%=", "&=", "|=", "^=",
     /** KW_BEGIN **/
-    "class", "import", "as", "def", "lambda", "pass", "del", "from", "with", "yield",
+    "class", "import", "as", "def", "lambda", "pass", "del", "from", "with", "yield", "async", "await",
     "None", "in", "is", "and", "or", "not", "True", "False", "global", "try", "except", "finally",
     "goto", "label",      // extended keywords, not available in cpython
     "while", "for", "if", "elif", "else", "break", "continue", "return", "assert", "raise",
@@ -96,22 +96,26 @@ struct Parser {
     const char* curr_char;
     int current_line = 1;
     Token prev, curr;
-    std::queue<Token> nexts;
+    std::vector<Token> nexts;      // pending tokens, consumed from nexts_i
+    int nexts_i = 0;
     std::stack<int> indents;
 
     int brackets_level = 0;
 
     Token next_token(){
-        if(nexts.empty()){
+        if(nexts_i == nexts.size()){
             return Token{TK("@error"), token_start, (int)(curr_char - token_start), current_line};
         }
-        Token t = nexts.front();
+        Token t = std::move(nexts[nexts_i++]);
+        // the lexer can run ahead (e.g. dedents), so compact once half of the buffer is consumed
+        if(nexts_i * 2 >= nexts.size()){
+            nexts.erase(nexts.begin(), nexts.begin() + nexts_i);
+            nexts_i = 0;
+        }
         if(t.type == TK("@eof") && indents.size()>1){
-            nexts.pop();
             indents.pop();
             return Token{TK("@dedent"), token_start, 0, current_line};
         }
-        nexts.pop();
         return t;
     }
 
@@ -148,11 +152,11 @@ struct Parser {
         // https://docs.python.org/3/reference/lexical_analysis.html#indentation
         if(spaces > indents.top()){
             indents.push(spaces);
-            nexts.push(Token{TK("@indent"), token_start, 0, current_line});
+            nexts.push_back(Token{TK("@indent"), token_start, 0, current_line});
         } else if(spaces < indents.top()){
             while(spaces < indents.top()){
                 indents.pop();
-                nexts.push(Token{TK("@dedent"), token_start, 0, current_line});
+                nexts.push_back(Token{TK("@dedent"), token_start, 0, current_line});
             }
             if(spaces != indents.top()){
                 return false;
@@ -271,7 +275,7 @@ struct Parser {
             case TK("{"): case TK("["): case TK("("): brackets_level++; break;
             case TK(")"): case TK("]"): case TK("}"): brackets_level--; break;
         }
-        nexts.push( Token{
+        nexts.push_back( Token{
             type,
             token_start,
             (int)(curr_char - token_start),
@@ -289,7 +293,7 @@ struct Parser {
         this->src = src;
         this->token_start = src->source;
         this->curr_char = src->source;
-        this->nexts.push(Token{TK("@sof"), token_start, 0, current_line});
+        this->nexts.push_back(Token{TK("@sof"), token_start, 0, current_line});
         this->indents.push(0);
     }
 };
\ No newline at end of file
@@ -4,11 +4,15 @@
 #include "compiler.h"
 #include "repl.h"
 #include "iter.h"
+#include "cffi.h"
+#include "concurrent.h"
+#include "asyncio.h"
 
 #define CPP_LAMBDA(x) ([](VM* vm, pkpy::Args& args) { return x; })
 #define CPP_NOT_IMPLEMENTED() ([](VM* vm, pkpy::Args& args) { vm->NotImplementedError(); return vm->None; })
 
 CodeObject_ VM::compile(Str source, Str filename, CompileMode mode) {
+    pkpy::_HeapScope heap_scope(heap.get());
     Compiler compiler(this, source.c_str(), filename, mode);
     try{
         return compiler.compile();
@@ -59,6 +63,35 @@ void init_builtins(VM* _vm) {
         return vm->None;
     });
 
+    _vm->bind_builtin_func<-1>("print", {
+        {"sep", _vm->None}, {"end", _vm->None}, {"file", _vm->None}, {"flush", _vm->False}
+    }, [](VM* vm, pkpy::Args& args) {
+        int n = args.size() - 4;
+        const PyVar& sep = args[n];
+        const PyVar& end = args[n+1];
+        const PyVar& file = args[n+2];
+        bool flush = vm->PyBool_AS_C(vm->asBool(args[n+3]));
+        Str s;
+        for(int i=0; i<n; i++){
+            if(i > 0){
+                if(sep == vm->None) s += ' ';
+                else s += vm->PyStr_AS_C(sep);
+            }
+            if(args[i]->is_type(vm->tp_str)) s += vm->PyStr_AS_C(args[i]);
+            else s += vm->PyStr_AS_C(vm->asStr(args[i]));
+        }
+        if(end == vm->None) s += '\n';
+        else s += vm->PyStr_AS_C(end);
+        if(file == vm->None){
+            vm->_stdout->write(s.data(), s.size());
+            if(flush) vm->_stdout->flush();
+        }else{
+            vm->call(file, "write", pkpy::one_arg(vm->PyStr(std::move(s))));
+            if(flush) vm->call(file, "flush");
+        }
+        return vm->None;
+    });
+
     _vm->bind_builtin_func<0>("super", [](VM* vm, pkpy::Args& args) {
         const PyVar* self = vm->top_frame()->f_locals().try_get(m_self);
         if(self == nullptr) vm->TypeError("super() can only be called in a class");
@@ -66,17 +99,18 @@ void init_builtins(VM* _vm) {
     });
 
     _vm->bind_builtin_func<1>("eval", [](VM* vm, pkpy::Args& args) {
-        CodeObject_ code = vm->compile(vm->PyStr_AS_C(args[0]), "<eval>", EVAL_MODE);
+        CodeObject_ code = vm->compile_cached(vm->PyStr_AS_C(args[0]), EVAL_MODE);
         return vm->_exec(code, vm->top_frame()->_module, vm->top_frame()->_locals);
     });
 
     _vm->bind_builtin_func<1>("exec", [](VM* vm, pkpy::Args& args) {
-        CodeObject_ code = vm->compile(vm->PyStr_AS_C(args[0]), "<exec>", EXEC_MODE);
+        CodeObject_ code = vm->compile_cached(vm->PyStr_AS_C(args[0]), EXEC_MODE);
         vm->_exec(code, vm->top_frame()->_module, vm->top_frame()->_locals);
         return vm->None;
     });
 
     _vm->bind_builtin_func<-1>("exit", [](VM* vm, pkpy::Args& args) {
+        vm->flush_output();
         if(args.size() == 0) std::exit(0);
         else if(args.size() == 1) std::exit((int)vm->PyInt_AS_C(args[0]));
         else vm->TypeError("exit() takes at most 1 argument");
@@ -89,8 +123,8 @@ void init_builtins(VM* _vm) {
 
     _vm->bind_builtin_func<1>("chr", [](VM* vm, pkpy::Args& args) {
         i64 i = vm->PyInt_AS_C(args[0]);
-        if (i < 0 || i > 128) vm->ValueError("chr() arg not in range(128)");
-        return vm->PyStr(std::string(1, (char)i));
+        if (i < 0 || i >= 128) vm->ValueError("chr() arg not in range(128)");
+        return vm->_ascii_str_pool[i];
     });
 
     _vm->bind_builtin_func<1>("ord", [](VM* vm, pkpy::Args& args) {
@@ -120,15 +154,13 @@ void init_builtins(VM* _vm) {
     });
 
     _vm->bind_builtin_func<1>("dir", [](VM* vm, pkpy::Args& args) {
-        std::vector<Str> names;
-        if(args[0]->is_attr_valid()){
-            for (auto& [k, _] : args[0]->attr()) names.push_back(k);
-        }
+        std::vector<StrName> names;
+        if(args[0]->is_attr_valid()) names = args[0]->attr_keys();
         for (auto& [k, _] : vm->_t(args[0])->attr()) {
             if (std::find(names.begin(), names.end(), k) == names.end()) names.push_back(k);
         }
         pkpy::List ret;
-        for (const auto& name : names) ret.push_back(vm->PyStr(name));
+        for (const auto& name : names) ret.push_back(vm->PyStr(name.str()));
         return vm->PyList(std::move(ret));
     });
 
@@ -195,14 +227,11 @@ void init_builtins(VM* _vm) {
         if (args[0]->is_type(vm->tp_bool)) return vm->PyInt(vm->PyBool_AS_C(args[0]) ? 1 : 0);
         if (args[0]->is_type(vm->tp_str)) {
             const Str& s = vm->PyStr_AS_C(args[0]);
-            try{
-                size_t parsed = 0;
-                i64 val = std::stoll(s, &parsed, 10);
-                if(parsed != s.size()) throw std::invalid_argument("");
-                return vm->PyInt(val);
-            }catch(std::invalid_argument&){
-                vm->ValueError("invalid literal for int(): '" + s + "'");
-            }
+            i64 val;
+            std::errc ec = parse_int(s, val);
+            if(ec == std::errc::result_out_of_range) vm->ValueError("int() literal is too large: " + s.escape(true));
+            if(ec != std::errc()) vm->ValueError("invalid literal for int(): " + s.escape(true));
+            return vm->PyInt(val);
         }
         vm->TypeError("int() argument must be a int, float, bool or str");
         return vm->None;
@@ -241,33 +270,20 @@ void init_builtins(VM* _vm) {
         if (args[0]->is_type(vm->tp_bool)) return vm->PyFloat(vm->PyBool_AS_C(args[0]) ? 1.0 : 0.0);
         if (args[0]->is_type(vm->tp_str)) {
             const Str& s = vm->PyStr_AS_C(args[0]);
-            if(s == "inf") return vm->PyFloat(INFINITY);
-            if(s == "-inf") return vm->PyFloat(-INFINITY);
-            try{
-                f64 val = std::stod(s);
-                return vm->PyFloat(val);
-            }catch(std::invalid_argument&){
-                vm->ValueError("invalid literal for float(): '" + s + "'");
-            }
+            f64 val;
+            if(parse_float(s, val) != std::errc()) vm->ValueError("invalid literal for float(): " + s.escape(true));
+            return vm->PyFloat(val);
         }
         vm->TypeError("float() argument must be a int, float, bool or str");
         return vm->None;
     });
 
-    _vm->bind_method<0>("float", "__repr__", [](VM* vm, pkpy::Args& args) {
-        f64 val = vm->PyFloat_AS_C(args[0]);
-        if(std::isinf(val) || std::isnan(val)) return vm->PyStr(std::to_string(val));
-        StrStream ss;
-        ss << std::setprecision(std::numeric_limits<f64>::max_digits10-1) << val;
-        std::string s = ss.str();
-        if(std::all_of(s.begin()+1, s.end(), isdigit)) s += ".0";
-        return vm->PyStr(s);
-    });
+    _vm->bind_method<0>("float", "__repr__", CPP_LAMBDA(vm->PyStr(float_repr(vm->PyFloat_AS_C(args[0])))));
 
     _vm->bind_method<0>("float", "__json__", [](VM* vm, pkpy::Args& args) {
         f64 val = vm->PyFloat_AS_C(args[0]);
         if(std::isinf(val) || std::isnan(val)) vm->ValueError("cannot jsonify 'nan' or 'inf'");
-        return vm->PyStr(std::to_string(val));
+        return vm->PyStr(float_repr(val));
     });
 
     /************ PyString ************/
@@ -276,6 +292,7 @@ void init_builtins(VM* _vm) {
     _vm->bind_method<1>("str", "__add__", [](VM* vm, pkpy::Args& args) {
         const Str& lhs = vm->PyStr_AS_C(args[0]);
         const Str& rhs = vm->PyStr_AS_C(args[1]);
+        vm->_reserve(lhs.size() + rhs.size());
         return vm->PyStr(lhs + rhs);
     });
 
@@ -348,14 +365,26 @@ void init_builtins(VM* _vm) {
         const Str& _self = vm->PyStr_AS_C(args[0]);
         const Str& _old = vm->PyStr_AS_C(args[1]);
         const Str& _new = vm->PyStr_AS_C(args[2]);
-        Str _copy = _self;
-        // replace all occurences of _old with _new in _copy
-        size_t pos = 0;
-        while ((pos = _copy.find(_old, pos)) != std::string::npos) {
-            _copy.replace(pos, _old.length(), _new);
-            pos += _new.length();
+        // an empty _old matches before every code point and at the end
+        auto next = [&](size_t pos){
+            if(!_old.empty()) return _self.find(_old, pos);
+            while(pos < _self.size() && (_self[pos] & 0xC0) == 0x80) pos++;
+            return pos;
+        };
+        size_t step = std::max<size_t>(_old.size(), 1);
+        i64 count = 0;
+        for(size_t pos = next(0); pos <= _self.size(); pos = next(pos + step)) count++;
+        i64 size = (i64)_self.size() + count * ((i64)_new.size() - (i64)_old.size());
+        vm->_reserve(size);
+        Str ret; ret.reserve(size);
+        size_t last = 0;
+        for(size_t pos = next(0); pos <= _self.size(); pos = next(pos + step)){
+            ret += std::string_view(_self).substr(last, pos - last);
+            ret += _new;
+            last = pos + _old.size();
         }
-        return vm->PyStr(_copy);
+        if(last < _self.size()) ret += std::string_view(_self).substr(last);
+        return vm->PyStr(std::move(ret));
     });
 
     _vm->bind_method<1>("str", "startswith", [](VM* vm, pkpy::Args& args) {
@@ -372,20 +401,162 @@ void init_builtins(VM* _vm) {
 
     _vm->bind_method<1>("str", "join", [](VM* vm, pkpy::Args& args) {
         const Str& self = vm->PyStr_AS_C(args[0]);
-        StrStream ss;
         PyVar obj = vm->asList(args[1]);
         const pkpy::List& list = vm->PyList_AS_C(obj);
+        size_t size = 0;
+        for (int i = 0; i < list.size(); ++i) {
+            if (i > 0) size += self.size();
+            size += vm->PyStr_AS_C(list[i]).size();
+        }
+        vm->_reserve(size);
+        Str ret; ret.reserve(size);
         for (int i = 0; i < list.size(); ++i) {
-            if (i > 0) ss << self;
-            ss << vm->PyStr_AS_C(list[i]);
+            if (i > 0) ret += self;
+            ret += vm->PyStr_AS_C(list[i]);
+        }
+        return vm->PyStr(std::move(ret));
+    });
+
+    _vm->bind_method<0>("str", "encode", [](VM* vm, pkpy::Args& args) {
+        const Str& self = vm->PyStr_AS_C(args[0]);
+        vm->_reserve(self.size());
+        return vm->PyBytes(pkpy::Bytes(self));
+    });
+
+    /************ PyBytes ************/
+    _vm->bind_static_method<1>("bytes", "__new__", [](VM* vm, pkpy::Args& args) {
+        if(args[0]->is_type(vm->tp_int)){
+            i64 n = vm->PyInt_AS_C(args[0]);
+            if(n < 0) vm->ValueError("negative count");
+            vm->_reserve(n);
+            return vm->PyBytes(pkpy::Bytes(n, '\0'));
+        }
+        if(args[0]->is_type(vm->tp_str)) vm->TypeError("string argument without an encoding");
+        if(args[0]->is_type(vm->tp_bytes)) return args[0];
+        if(args[0]->is_type(vm->tp_bytearray)) return vm->PyBytes(vm->PyByteArray_AS_C(args[0]));
+        PyVar obj = vm->asList(args[0]);
+        const pkpy::List& list = vm->PyList_AS_C(obj);
+        pkpy::Bytes ret(list.size(), '\0');
+        for(int i=0; i<list.size(); i++){
+            i64 b = vm->PyInt_AS_C(list[i]);
+            if(b < 0 || b > 255) vm->ValueError("bytes must be in range(0, 256)");
+            ret[i] = (char)b;
+        }
+        return vm->PyBytes(std::move(ret));
+    });
+
+    _vm->bind_method<0>("bytes", "__len__", CPP_LAMBDA(vm->PyInt(vm->PyBytes_AS_C(args[0]).size())));
+
+    _vm->bind_method<1>("bytes", "__getitem__", [](VM* vm, pkpy::Args& args) {
+        const pkpy::Bytes& self = vm->PyBytes_AS_C(args[0]);
+        if(args[1]->is_type(vm->tp_slice)){
+            pkpy::Slice s = vm->PySlice_AS_C(args[1]);
+            s.normalize(self.size());
+            return vm->PyBytes(pkpy::Bytes(self.substr(s.start, s.stop - s.start)));
+        }
+        int index = (int)vm->PyInt_AS_C(args[1]);
+        index = vm->normalized_index(index, self.size());
+        return vm->PyInt((unsigned char)self[index]);
+    });
+
+    _vm->bind_method<1>("bytes", "__add__", [](VM* vm, pkpy::Args& args) {
+        const pkpy::Bytes& lhs = vm->PyBytes_AS_C(args[0]);
+        const pkpy::Bytes& rhs = vm->PyBytes_AS_C(args[1]);
+        vm->_reserve(lhs.size() + rhs.size());
+        return vm->PyBytes(pkpy::Bytes(lhs + rhs));
+    });
+
+    _vm->bind_method<1>("bytes", "__eq__", [](VM* vm, pkpy::Args& args) {
+        if(!args[1]->is_type(vm->tp_bytes) && !args[1]->is_type(vm->tp_bytearray)) return vm->False;
+        return vm->PyBool(vm->PyBytes_AS_C(args[0]) == OBJ_GET(pkpy::Bytes, args[1]));
+    });
+
+    _vm->bind_method<1>("bytes", "__ne__", [](VM* vm, pkpy::Args& args) {
+        if(!args[1]->is_type(vm->tp_bytes) && !args[1]->is_type(vm->tp_bytearray)) return vm->True;
+        return vm->PyBool(vm->PyBytes_AS_C(args[0]) != OBJ_GET(pkpy::Bytes, args[1]));
+    });
+
+    _vm->bind_method<0>("bytes", "__repr__", [](VM* vm, pkpy::Args& args) {
+        const pkpy::Bytes& self = vm->PyBytes_AS_C(args[0]);
+        StrStream ss;
+        ss << "b'";
+        for(unsigned char c : self){
+            switch(c){
+                case '\'': ss << "\\'"; break;
+                case '\\': ss << "\\\\"; break;
+                case '\n': ss << "\\n"; break;
+                case '\r': ss << "\\r"; break;
+                case '\t': ss << "\\t"; break;
+                default:
+                    if(c >= 0x20 && c < 0x7f) ss << c;
+                    else ss << "\\x" << std::hex << std::setw(2) << std::setfill('0') << (int)c;
+            }
         }
+        ss << "'";
         return vm->PyStr(ss.str());
     });
 
+    _vm->bind_method<0>("bytes", "decode", [](VM* vm, pkpy::Args& args) {
+        const pkpy::Bytes& self = vm->PyBytes_AS_C(args[0]);
+        vm->_reserve(self.size());
+        return vm->PyStr(Str(self));
+    });
+
+    /************ PyByteArray ************/
+    _vm->bind_static_method<1>("bytearray", "__new__", [](VM* vm, pkpy::Args& args) {
+        return vm->PyByteArray(vm->PyBytes_AS_C(vm->call(vm->builtins->attr("bytes"), pkpy::one_arg(args[0]))));
+    });
+
+    _vm->bind_method<0>("bytearray", "__len__", CPP_LAMBDA(vm->PyInt(vm->PyByteArray_AS_C(args[0]).size())));
+
+    _vm->bind_method<1>("bytearray", "__getitem__", [](VM* vm, pkpy::Args& args) {
+        const pkpy::Bytes& self = vm->PyByteArray_AS_C(args[0]);
+        if(args[1]->is_type(vm->tp_slice)){
+            pkpy::Slice s = vm->PySlice_AS_C(args[1]);
+            s.normalize(self.size());
+            return vm->PyByteArray(pkpy::Bytes(self.substr(s.start, s.stop - s.start)));
+        }
+        int index = (int)vm->PyInt_AS_C(args[1]);
+        index = vm->normalized_index(index, self.size());
+        return vm->PyInt((unsigned char)self[index]);
+    });
+
+    _vm->bind_method<2>("bytearray", "__setitem__", [](VM* vm, pkpy::Args& args) {
+        pkpy::Bytes& self = vm->PyByteArray_AS_C(args[0]);
+        int index = (int)vm->PyInt_AS_C(args[1]);
+        index = vm->normalized_index(index, self.size());
+        i64 b = vm->PyInt_AS_C(args[2]);
+        if(b < 0 || b > 255) vm->ValueError("byte must be in range(0, 256)");
+        self[index] = (char)b;
+        return vm->None;
+    });
+
+    _vm->bind_method<1>("bytearray", "__eq__", [](VM* vm, pkpy::Args& args) {
+        if(!args[1]->is_type(vm->tp_bytes) && !args[1]->is_type(vm->tp_bytearray)) return vm->False;
+        return vm->PyBool(vm->PyByteArray_AS_C(args[0]) == OBJ_GET(pkpy::Bytes, args[1]));
+    });
+
+    _vm->bind_method<1>("bytearray", "__ne__", [](VM* vm, pkpy::Args& args) {
+        if(!args[1]->is_type(vm->tp_bytes) && !args[1]->is_type(vm->tp_bytearray)) return vm->True;
+        return vm->PyBool(vm->PyByteArray_AS_C(args[0]) != OBJ_GET(pkpy::Bytes, args[1]));
+    });
+
+    _vm->bind_method<0>("bytearray", "__repr__", [](VM* vm, pkpy::Args& args) {
+        PyVar bytes = vm->PyBytes(vm->PyByteArray_AS_C(args[0]));
+        return vm->PyStr("bytearray(" + vm->PyStr_AS_C(vm->asRepr(bytes)) + ")");
+    });
+
+    _vm->bind_method<0>("bytearray", "decode", [](VM* vm, pkpy::Args& args) {
+        const pkpy::Bytes& self = vm->PyByteArray_AS_C(args[0]);
+        vm->_reserve(self.size());
+        return vm->PyStr(Str(self));
+    });
+
     /************ PyList ************/
     _vm->bind_method<1>("list", "append", [](VM* vm, pkpy::Args& args) {
         pkpy::List& self = vm->PyList_AS_C(args[0]);
         self.push_back(args[1]);
+        args[0]->_account();
         return vm->None;
     });
 
@@ -398,6 +569,7 @@ void init_builtins(VM* _vm) {
     _vm->bind_method<1>("list", "__mul__", [](VM* vm, pkpy::Args& args) {
         const pkpy::List& self = vm->PyList_AS_C(args[0]);
         int n = (int)vm->PyInt_AS_C(args[1]);
+        vm->_reserve((i64)self.size() * std::max(n, 0) * sizeof(PyVar));
         pkpy::List result;
         result.reserve(self.size() * n);
         for(int i = 0; i < n; i++) result.insert(result.end(), self.begin(), self.end());
@@ -411,6 +583,7 @@ void init_builtins(VM* _vm) {
         if(index < 0) index = 0;
         if(index > _self.size()) index = _self.size();
         _self.insert(_self.begin() + index, args[2]);
+        args[0]->_account();
         return vm->None;
     });
 
@@ -424,6 +597,7 @@ void init_builtins(VM* _vm) {
     _vm->bind_method<1>("list", "__add__", [](VM* vm, pkpy::Args& args) {
         const pkpy::List& self = vm->PyList_AS_C(args[0]);
         const pkpy::List& obj = vm->PyList_AS_C(args[1]);
+        vm->_reserve((i64)(self.size() + obj.size()) * sizeof(PyVar));
         pkpy::List new_list = self;
         new_list.insert(new_list.end(), obj.begin(), obj.end());
         return vm->PyList(new_list);
@@ -521,6 +695,9 @@ void init_builtins(VM* _vm) {
     });
 
     _vm->bind_method<0>("ellipsis", "__repr__", CPP_LAMBDA(vm->PyStr("Ellipsis")));
+
+    _vm->register_class<VoidP>(_vm->builtins);
+    _vm->register_class<Coroutine>(_vm->builtins);
 }
 
 #include "builtins.h"
@@ -551,11 +728,26 @@ void add_module_sys(VM* vm){
 
     vm->bind_func<1>(mod, "getrefcount", CPP_LAMBDA(vm->PyInt(args[0].use_count())));
     vm->bind_func<0>(mod, "getrecursionlimit", CPP_LAMBDA(vm->PyInt(vm->recursionlimit)));
+    vm->bind_func<0>(mod, "getallocatedbytes", CPP_LAMBDA(vm->PyInt(vm->heap->allocated)));
+    // the object plus the buffers it owns, not the objects it refers to
+    vm->bind_func<1>(mod, "getsizeof", CPP_LAMBDA(vm->PyInt(args[0]->_object_size() + args[0]->_payload())));
 
     vm->bind_func<1>(mod, "setrecursionlimit", [](VM* vm, pkpy::Args& args) {
         vm->recursionlimit = (int)vm->PyInt_AS_C(args[0]);
         return vm->None;
     });
+
+    // (hits, misses, currsize) of the eval()/exec() code cache
+    vm->bind_func<0>(mod, "getcodecacheinfo", [](VM* vm, pkpy::Args& args) {
+        i64 size = vm->_eval_cache.size() + vm->_exec_cache.size();
+        return vm->PyTuple({vm->PyInt(vm->_code_cache_hits), vm->PyInt(vm->_code_cache_misses), vm->PyInt(size)});
+    });
+
+    vm->bind_func<0>(mod, "clearcodecache", [](VM* vm, pkpy::Args& args) {
+        vm->_eval_cache.clear();
+        vm->_exec_cache.clear();
+        return vm->None;
+    });
 }
 
 void add_module_json(VM* vm){
@@ -574,18 +766,18 @@ void add_module_math(VM* vm){
     vm->setattr(mod, "pi", vm->PyFloat(3.1415926535897932384));
     vm->setattr(mod, "e" , vm->PyFloat(2.7182818284590452354));
 
-    vm->bind_func<1>(mod, "log", CPP_LAMBDA(vm->PyFloat(std::log(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "log10", CPP_LAMBDA(vm->PyFloat(std::log10(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "log2", CPP_LAMBDA(vm->PyFloat(std::log2(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "sin", CPP_LAMBDA(vm->PyFloat(std::sin(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "cos", CPP_LAMBDA(vm->PyFloat(std::cos(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "tan", CPP_LAMBDA(vm->PyFloat(std::tan(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "isnan", CPP_LAMBDA(vm->PyBool(std::isnan(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "isinf", CPP_LAMBDA(vm->PyBool(std::isinf(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "fabs", CPP_LAMBDA(vm->PyFloat(std::fabs(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "floor", CPP_LAMBDA(vm->PyInt((i64)std::floor(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "ceil", CPP_LAMBDA(vm->PyInt((i64)std::ceil(vm->num_to_float(args[0])))));
-    vm->bind_func<1>(mod, "sqrt", CPP_LAMBDA(vm->PyFloat(std::sqrt(vm->num_to_float(args[0])))));
+    pkpy::bind_native(vm, mod, "log", [](f64 x){ return std::log(x); });
+    pkpy::bind_native(vm, mod, "log10", [](f64 x){ return std::log10(x); });
+    pkpy::bind_native(vm, mod, "log2", [](f64 x){ return std::log2(x); });
+    pkpy::bind_native(vm, mod, "sin", [](f64 x){ return std::sin(x); });
+    pkpy::bind_native(vm, mod, "cos", [](f64 x){ return std::cos(x); });
+    pkpy::bind_native(vm, mod, "tan", [](f64 x){ return std::tan(x); });
+    pkpy::bind_native(vm, mod, "isnan", [](f64 x){ return (bool)std::isnan(x); });
+    pkpy::bind_native(vm, mod, "isinf", [](f64 x){ return (bool)std::isinf(x); });
+    pkpy::bind_native(vm, mod, "fabs", [](f64 x){ return std::fabs(x); });
+    pkpy::bind_native(vm, mod, "floor", [](f64 x){ return (i64)std::floor(x); });
+    pkpy::bind_native(vm, mod, "ceil", [](f64 x){ return (i64)std::ceil(x); });
+    pkpy::bind_native(vm, mod, "sqrt", [](f64 x){ return std::sqrt(x); });
 }
 
 void add_module_dis(VM* vm){
@@ -597,145 +789,569 @@ void add_module_dis(VM* vm){
     });
 }
 
-#include <fstream>
 struct FileIO {
     PY_CLASS(io, FileIO)
 
+    static const size_t kBufferSize = 64 * 1024;
+
     Str file;
     Str mode;
-    std::fstream _fs;
+    bool binary;
+    FILE* fp = nullptr;
+    std::vector<char> _buf;     // bytes in [_pos, _end) are read but not yet consumed
+    size_t _pos = 0;
+    size_t _end = 0;
 
     FileIO(VM* vm, Str file, Str mode): file(file), mode(mode) {
-        if(mode == "rt" || mode == "r"){
-            _fs.open(file, std::ios::in);
-        }else if(mode == "wt" || mode == "w"){
-            _fs.open(file, std::ios::out);
-        }else if(mode == "at" || mode == "a"){
-            _fs.open(file, std::ios::app);
+        binary = mode.find('b') != Str::npos;
+        if(mode.empty() || mode.find_first_not_of("rwabt") != Str::npos || std::string("rwa").find(mode[0]) == std::string::npos){
+            vm->ValueError("invalid mode: " + mode.escape(true));
         }
-        if(!_fs.is_open()) vm->IOError(strerror(errno));
+        std::string cmode(1, mode[0]);
+        if(binary) cmode += 'b';
+        fp = fopen(file.c_str(), cmode.c_str());
+        if(fp == nullptr) vm->IOError(strerror(errno));
+        // reads go through _buf, so stdio buffering would only add a copy
+        if(readable()) setvbuf(fp, nullptr, _IONBF, 0);
     }
 
-    static void _register(VM* vm, PyVar mod, PyVar type){
-        vm->bind_static_method<2>(type, "__new__", [](VM* vm, pkpy::Args& args){
-            return vm->new_object<FileIO>(
-                vm, vm->PyStr_AS_C(args[0]), vm->PyStr_AS_C(args[1])
-            );
-        });
+    FileIO(FileIO&& other) noexcept : file(std::move(other.file)), mode(std::move(other.mode)),
+        binary(other.binary), fp(other.fp), _buf(std::move(other._buf)), _pos(other._pos), _end(other._end) {
+        other.fp = nullptr;
+    }
 
-        vm->bind_method<0>(type, "read", [](VM* vm, pkpy::Args& args){
-            FileIO& io = vm->py_cast<FileIO>(args[0]);
-            std::string buffer;
-            io._fs >> buffer;
-            return vm->PyStr(buffer);
-        });
+    FileIO(const FileIO&) = delete;
+    ~FileIO(){ close(); }
 
-        vm->bind_method<1>(type, "write", [](VM* vm, pkpy::Args& args){
-            FileIO& io = vm->py_cast<FileIO>(args[0]);
-            io._fs << vm->PyStr_AS_C(args[1]);
-            return vm->None;
-        });
+    inline bool readable() const { return mode[0] == 'r'; }
 
-        vm->bind_method<0>(type, "close", [](VM* vm, pkpy::Args& args){
-            FileIO& io = vm->py_cast<FileIO>(args[0]);
-            io._fs.close();
-            return vm->None;
-        });
+    void close(){
+        if(fp == nullptr) return;
+        fclose(fp);
+        fp = nullptr;
+    }
 
-        vm->bind_method<0>(type, "__exit__", [](VM* vm, pkpy::Args& args){
-            FileIO& io = vm->py_cast<FileIO>(args[0]);
-            io._fs.close();
-            return vm->None;
-        });
+    void _check(VM* vm, bool read){
+        if(fp == nullptr) vm->ValueError("I/O operation on closed file");
+        if(read != readable()) vm->IOError(read ? "file not readable" : "file not writable");
+    }
+
+    bool _fill(){
+        if(_pos < _end) return true;
+        if(_buf.empty()) _buf.resize(kBufferSize);
+        _pos = 0;
+        _end = fread(_buf.data(), 1, _buf.size(), fp);
+        return _end > 0;
+    }
+
+    size_t readinto(char* dst, size_t n){
+        size_t done = 0;
+        while(done < n){
+            if(_pos == _end && n - done >= kBufferSize){
+                // large reads bypass the buffer
+                size_t k = fread(dst + done, 1, n - done, fp);
+                if(k == 0) break;
+                done += k;
+                continue;
+            }
+            if(!_fill()) break;
+            size_t k = std::min(n - done, _end - _pos);
+            memcpy(dst + done, _buf.data() + _pos, k);
+            _pos += k;
+            done += k;
+        }
+        return done;
+    }
+
+    // bytes left in a seekable file, or -1
+    i64 _remaining(){
+        long pos = ftell(fp);
+        if(pos < 0 || fseek(fp, 0, SEEK_END) != 0) return -1;
+        long end = ftell(fp);
+        fseek(fp, pos, SEEK_SET);
+        return end < pos ? -1 : (i64)(end - pos);
+    }
 
-        vm->bind_method<0>(type, "__enter__", CPP_LAMBDA(vm->None));
+    // bytes that read(n) allocates up front, at most what is left of a seekable file; -1 if unknown
+    i64 _read_size(i64 n){
+        if(n >= 0 && n <= (i64)kBufferSize) return n;       // small reads skip the seeks
+        i64 left = _remaining();
+        if(left >= 0) left += _end - _pos;
+        if(n < 0) return left;
+        return left >= 0 ? std::min(n, left) : n;
     }
+
+    // `size` is _read_size(n)
+    std::string read(i64 n, i64 size){
+        std::string ret;
+        if(n >= 0){
+            ret.resize(size);
+            ret.resize(readinto(ret.data(), size));
+            return ret;
+        }
+        // a seekable file is read to its end in one sized read, straight into the result
+        if(size >= 0){
+            ret.resize(size);
+            ret.resize(readinto(ret.data(), size));
+        }
+        while(_fill()){
+            ret.append(_buf.data() + _pos, _end - _pos);
+            _pos = _end;
+        }
+        return ret;
+    }
+
+    // text mode counts code points; a lead byte starts each one
+    std::string read_chars(i64 n){
+        std::string ret;
+        i64 chars = 0;
+        while(_fill()){
+            unsigned char c = _buf[_pos];
+            if((c & 0xC0) != 0x80){
+                if(chars == n) break;
+                chars++;
+            }
+            ret.push_back((char)c);
+            _pos++;
+        }
+        return ret;
+    }
+
+    std::string readline(){
+        std::string line;
+        while(_fill()){
+            const char* begin = _buf.data() + _pos;
+            const char* nl = (const char*)memchr(begin, '\n', _end - _pos);
+            size_t k = nl ? nl - begin + 1 : _end - _pos;
+            line.append(begin, k);
+            _pos += k;
+            if(nl) break;
+        }
+        return line;
+    }
+
+    PyVar _wrap(VM* vm, std::string&& s){
+        if(binary) return vm->PyBytes(pkpy::Bytes(std::move(s)));
+        return vm->PyStr(Str(std::move(s)));
+    }
+
+    static void _register(VM* vm, PyVar mod, PyVar type);
 };
+
+class FileLineIter : public BaseIter {
+public:
+    FileLineIter(VM* vm, PyVar _ref) : BaseIter(vm, _ref) {}
+
+    PyVar next(){
+        FileIO& io = OBJ_GET(FileIO, _ref);
+        io._check(vm, true);
+        std::string line = io.readline();
+        if(line.empty()) return nullptr;
+        return io._wrap(vm, std::move(line));
+    }
+};
+
+void FileIO::_register(VM* vm, PyVar mod, PyVar type){
+    vm->bind_static_method<2>(type, "__new__", [](VM* vm, pkpy::Args& args){
+        return vm->new_object<FileIO>(
+            vm, vm->PyStr_AS_C(args[0]), vm->PyStr_AS_C(args[1])
+        );
+    });
+
+    vm->bind_method<-1>(type, "read", [](VM* vm, pkpy::Args& args){
+        FileIO& io = vm->py_cast<FileIO>(args[0]);
+        io._check(vm, true);
+        i64 n = args.size() > 1 ? vm->PyInt_AS_C(args[1]) : -1;
+        if(n >= 0 && !io.binary) return io._wrap(vm, io.read_chars(n));
+        i64 size = io._read_size(n);
+        vm->_reserve(std::max<i64>(size, 0));
+        return io._wrap(vm, io.read(n, size));
+    });
+
+    vm->bind_method<0>(type, "readline", [](VM* vm, pkpy::Args& args){
+        FileIO& io = vm->py_cast<FileIO>(args[0]);
+        io._check(vm, true);
+        return io._wrap(vm, io.readline());
+    });
+
+    vm->bind_method<1>(type, "readinto", [](VM* vm, pkpy::Args& args){
+        FileIO& io = vm->py_cast<FileIO>(args[0]);
+        io._check(vm, true);
+        pkpy::Bytes& buffer = vm->PyByteArray_AS_C(args[1]);     // bytes are immutable
+        return vm->PyInt(io.readinto(buffer.data(), buffer.size()));
+    });
+
+    vm->bind_method<0>(type, "__iter__", [](VM* vm, pkpy::Args& args){
+        vm->py_cast<FileIO>(args[0]);
+        return vm->PyIter(pkpy::make_shared<BaseIter, FileLineIter>(vm, args[0]));
+    });
+
+    vm->bind_method<1>(type, "write", [](VM* vm, pkpy::Args& args){
+        FileIO& io = vm->py_cast<FileIO>(args[0]);
+        io._check(vm, false);
+        const std::string& data = io.binary ? (const std::string&)vm->PyBytes_AS_C(args[1]) : vm->PyStr_AS_C(args[1]);
+        if(fwrite(data.data(), 1, data.size(), io.fp) != data.size()) vm->IOError(strerror(errno));
+        return vm->None;
+    });
+
+    vm->bind_method<0>(type, "flush", [](VM* vm, pkpy::Args& args){
+        FileIO& io = vm->py_cast<FileIO>(args[0]);
+        io._check(vm, false);
+        fflush(io.fp);
+        return vm->None;
+    });
+
+    vm->bind_method<0>(type, "close", [](VM* vm, pkpy::Args& args){
+        FileIO& io = vm->py_cast<FileIO>(args[0]);
+        io.close();
+        return vm->None;
+    });
+
+    vm->bind_method<0>(type, "__exit__", [](VM* vm, pkpy::Args& args){
+        FileIO& io = vm->py_cast<FileIO>(args[0]);
+        io.close();
+        return vm->None;
+    });
+
+    vm->bind_method<0>(type, "__enter__", CPP_LAMBDA(vm->None));
+}
+
 void add_module_io(VM* vm){
     PyVar mod = vm->new_module("io");
     PyVar type = vm->register_class<FileIO>(mod);
-    vm->bind_builtin_func<2>("open", [type](VM* vm, const pkpy::Args& args){
+    vm->bind_builtin_func<-1>("open", [type](VM* vm, const pkpy::Args& args){
+        if(args.size() == 1) return vm->call(type, pkpy::two_args(args[0], vm->PyStr("r")));
         return vm->call(type, args);
     });
 }
 
 void add_module_os(VM* vm){}
 
+struct ReProgram {
+    Str pattern;
+    bool literal;       // no metacharacters, matched with plain string search
+    std::unique_ptr<std::regex> _re;
+
+    ReProgram(const Str& pattern) : pattern(pattern) {
+        literal = pattern.find_first_of(".^$*+?()[]{}|\\") == std::string::npos;
+        if(!literal) _re = std::make_unique<std::regex>(pattern);
+    }
+
+    const std::regex& regex(){
+        if(_re == nullptr) _re = std::make_unique<std::regex>(pattern);
+        return *_re;
+    }
+
+    // byte spans of each group, {-1, -1} for groups that did not participate
+    bool search(const std::string& s, size_t pos, bool anchored, std::vector<std::pair<i64, i64>>& spans){
+        spans.clear();
+        if(pos > s.size()) return false;
+        if(literal){
+            size_t i;
+            if(anchored) i = s.compare(pos, pattern.size(), pattern) == 0 ? pos : std::string::npos;
+            else i = s.find(pattern, pos);
+            if(i == std::string::npos) return false;
+            spans.push_back({(i64)i, (i64)(i + pattern.size())});
+            return true;
+        }
+        auto flags = std::regex_constants::match_default;
+        if(pos > 0) flags |= std::regex_constants::match_prev_avail;
+        if(anchored) flags |= std::regex_constants::match_continuous;
+        std::smatch m;
+        if(!std::regex_search(s.begin() + pos, s.end(), m, regex(), flags)) return false;
+        for(size_t i=0; i<m.size(); i++){
+            if(!m[i].matched) spans.push_back({-1, -1});
+            else spans.push_back({m[i].first - s.begin(), m[i].second - s.begin()});
+        }
+        return true;
+    }
+
+    // find the next match at or after `pos` and move `pos` past it
+    bool next(const std::string& s, size_t& pos, std::vector<std::pair<i64, i64>>& spans){
+        if(!search(s, pos, false, spans)){
+            pos = s.size() + 1;
+            return false;
+        }
+        size_t end = spans[0].second;
+        if(end == (size_t)spans[0].first){
+            // empty match, step over one utf8 character
+            end++;
+            while(end < s.size() && (s[end] & 0xC0) == 0x80) end++;
+        }
+        pos = end;
+        return true;
+    }
+};
+
+typedef std::shared_ptr<ReProgram> ReProgram_;
+static THREAD_LOCAL pkpy::LRUCache<Str, ReProgram_> _re_cache(256);
+
+ReProgram_ _re_compile(VM* vm, const Str& pattern){
+    ReProgram_* cached = _re_cache.get(pattern);
+    if(cached != nullptr) return *cached;
+    ReProgram_ prog;
+    try{
+        prog = std::make_shared<ReProgram>(pattern);
+    }catch(std::regex_error& e){
+        vm->ValueError("invalid pattern " + pattern.escape(true) + ": " + e.what());
+    }
+    return _re_cache.put(pattern, prog);
+}
+
 struct ReMatch {
     PY_CLASS(re, Match)
 
-    i64 start;
-    i64 end;
-    std::smatch m;
-    ReMatch(i64 start, i64 end, std::smatch m) : start(start), end(end), m(m) {}
+    PyVar string;
+    std::vector<std::pair<i64, i64>> spans;
+    ReMatch(PyVar string, const std::vector<std::pair<i64, i64>>& spans) : string(string), spans(spans) {}
+
+    PyVar group(VM* vm, int index){
+        if(index < 0 || index >= spans.size()) vm->IndexError("no such group");
+        if(spans[index].first < 0) return vm->None;
+        const Str& s = OBJ_GET(Str, string);
+        return vm->PyStr(s.substr(spans[index].first, spans[index].second - spans[index].first));
+    }
 
     static void _register(VM* vm, PyVar mod, PyVar type){
         vm->bind_method<-1>(type, "__init__", CPP_NOT_IMPLEMENTED());
-        vm->bind_method<0>(type, "start", CPP_LAMBDA(vm->PyInt(vm->py_cast<ReMatch>(args[0]).start)));
-        vm->bind_method<0>(type, "end", CPP_LAMBDA(vm->PyInt(vm->py_cast<ReMatch>(args[0]).end)));
+        vm->bind_method<0>(type, "start", [](VM* vm, pkpy::Args& args) {
+            auto& self = vm->py_cast<ReMatch>(args[0]);
+            return vm->PyInt(OBJ_GET(Str, self.string)._to_u8_index(self.spans[0].first));
+        });
+
+        vm->bind_method<0>(type, "end", [](VM* vm, pkpy::Args& args) {
+            auto& self = vm->py_cast<ReMatch>(args[0]);
+            return vm->PyInt(OBJ_GET(Str, self.string)._to_u8_index(self.spans[0].second));
+        });
 
         vm->bind_method<0>(type, "span", [](VM* vm, pkpy::Args& args) {
             auto& self = vm->py_cast<ReMatch>(args[0]);
-            return vm->PyTuple({ vm->PyInt(self.start), vm->PyInt(self.end) });
+            const Str& s = OBJ_GET(Str, self.string);
+            return vm->PyTuple({ vm->PyInt(s._to_u8_index(self.spans[0].first)), vm->PyInt(s._to_u8_index(self.spans[0].second)) });
         });
 
-        vm->bind_method<1>(type, "group", [](VM* vm, pkpy::Args& args) {
+        vm->bind_method<-1>(type, "group", [](VM* vm, pkpy::Args& args) {
             auto& self = vm->py_cast<ReMatch>(args[0]);
-            int index = (int)vm->PyInt_AS_C(args[1]);
-            index = vm->normalized_index(index, self.m.size());
-            return vm->PyStr(self.m[index].str());
+            int index = args.size() > 1 ? (int)vm->PyInt_AS_C(args[1]) : 0;
+            index = vm->normalized_index(index, self.spans.size());
+            return self.group(vm, index);
+        });
+
+        vm->bind_method<0>(type, "groups", [](VM* vm, pkpy::Args& args) {
+            auto& self = vm->py_cast<ReMatch>(args[0]);
+            pkpy::List ret;
+            for(int i=1; i<self.spans.size(); i++) ret.push_back(self.group(vm, i));
+            return vm->PyTuple(std::move(ret));
         });
     }
 };
 
-PyVar _regex_search(const Str& pattern, const Str& string, bool fromStart, VM* vm){
-    std::regex re(pattern);
-    std::smatch m;
-    if(std::regex_search(string, m, re)){
-        if(fromStart && m.position() != 0) return vm->None;
-        i64 start = string._to_u8_index(m.position());
-        i64 end = string._to_u8_index(m.position() + m.length());
-        return vm->new_object<ReMatch>(start, end, m);
+class ReMatchIter : public BaseIter {
+    ReProgram_ prog;
+    size_t pos = 0;
+    std::vector<std::pair<i64, i64>> spans;
+public:
+    ReMatchIter(VM* vm, PyVar string, ReProgram_ prog) : BaseIter(vm, string), prog(prog) {}
+
+    PyVar next(){
+        if(!prog->next(OBJ_GET(Str, _ref), pos, spans)) return nullptr;
+        return vm->new_object<ReMatch>(_ref, spans);
+    }
+};
+
+PyVar _re_match(VM* vm, ReProgram& prog, const PyVar& string, bool anchored){
+    std::vector<std::pair<i64, i64>> spans;
+    if(!prog.search(vm->PyStr_AS_C(string), 0, anchored, spans)) return vm->None;
+    return vm->new_object<ReMatch>(string, spans);
+}
+
+PyVar _re_sub(VM* vm, ReProgram& prog, const Str& repl, const Str& string){
+    if(!prog.literal || repl.find('$') != std::string::npos){
+        // the size is only known afterwards, so the limit is checked before the result is kept
+        std::string ret = std::regex_replace(string, prog.regex(), repl);
+        vm->_reserve(ret.size());
+        return vm->PyStr(std::move(ret));
+    }
+    i64 count = 0;
+    for(size_t pos = 0; !prog.pattern.empty() && (pos = string.find(prog.pattern, pos)) != std::string::npos; pos += prog.pattern.size()) count++;
+    i64 size = (i64)string.size() + count * ((i64)repl.size() - (i64)prog.pattern.size());
+    vm->_reserve(size);
+    Str ret; ret.reserve(size);
+    size_t last = 0;
+    size_t pos;
+    while(!prog.pattern.empty() && (pos = string.find(prog.pattern, last)) != std::string::npos){
+        ret += std::string_view(string).substr(last, pos - last);
+        ret += repl;
+        last = pos + prog.pattern.size();
+    }
+    ret += std::string_view(string).substr(last);
+    return vm->PyStr(std::move(ret));
+}
+
+PyVar _re_split(VM* vm, ReProgram& prog, const Str& string){
+    // like std::sregex_token_iterator, the trailing empty string is not included
+    pkpy::List ret;
+    std::vector<std::pair<i64, i64>> spans;
+    size_t pos = 0, last = 0;
+    while(prog.next(string, pos, spans)){
+        if(spans[0].first == spans[0].second) continue;
+        ret.push_back(vm->PyStr(string.substr(last, spans[0].first - last)));
+        last = spans[0].second;
+    }
+    if(last < string.size()) ret.push_back(vm->PyStr(string.substr(last)));
+    return vm->PyList(std::move(ret));
+}
+
+PyVar _re_findall(VM* vm, ReProgram& prog, const Str& string){
+    pkpy::List ret;
+    std::vector<std::pair<i64, i64>> spans;
+    size_t pos = 0;
+    auto group = [&](int i){
+        if(spans[i].first < 0) return vm->PyStr("");
+        return vm->PyStr(string.substr(spans[i].first, spans[i].second - spans[i].first));
+    };
+    while(prog.next(string, pos, spans)){
+        if(spans.size() <= 2){
+            ret.push_back(group(spans.size() - 1));
+            continue;
+        }
+        pkpy::List groups;
+        for(int i=1; i<spans.size(); i++) groups.push_back(group(i));
+        ret.push_back(vm->PyTuple(std::move(groups)));
+    }
+    return vm->PyList(std::move(ret));
+}
+
+struct RePattern {
+    PY_CLASS(re, Pattern)
+
+    ReProgram_ prog;
+    RePattern(ReProgram_ prog) : prog(prog) {}
+
+    static void _register(VM* vm, PyVar mod, PyVar type){
+        vm->bind_method<-1>(type, "__init__", CPP_NOT_IMPLEMENTED());
+        vm->bind_method<1>(type, "match", [](VM* vm, pkpy::Args& args) {
+            return _re_match(vm, *vm->py_cast<RePattern>(args[0]).prog, args[1], true);
+        });
+
+        vm->bind_method<1>(type, "search", [](VM* vm, pkpy::Args& args) {
+            return _re_match(vm, *vm->py_cast<RePattern>(args[0]).prog, args[1], false);
+        });
+
+        vm->bind_method<2>(type, "sub", [](VM* vm, pkpy::Args& args) {
+            auto& self = vm->py_cast<RePattern>(args[0]);
+            return _re_sub(vm, *self.prog, vm->PyStr_AS_C(args[1]), vm->PyStr_AS_C(args[2]));
+        });
+
+        vm->bind_method<1>(type, "split", [](VM* vm, pkpy::Args& args) {
+            return _re_split(vm, *vm->py_cast<RePattern>(args[0]).prog, vm->PyStr_AS_C(args[1]));
+        });
+
+        vm->bind_method<1>(type, "findall", [](VM* vm, pkpy::Args& args) {
+            return _re_findall(vm, *vm->py_cast<RePattern>(args[0]).prog, vm->PyStr_AS_C(args[1]));
+        });
+
+        vm->bind_method<1>(type, "finditer", [](VM* vm, pkpy::Args& args) {
+            auto& self = vm->py_cast<RePattern>(args[0]);
+            vm->check_type(args[1], vm->tp_str);
+            return vm->PyIter(pkpy::make_shared<BaseIter, ReMatchIter>(vm, args[1], self.prog));
+        });
     }
-    return vm->None;
 };
 
 void add_module_re(VM* vm){
     PyVar mod = vm->new_module("re");
     vm->register_class<ReMatch>(mod);
+    vm->register_class<RePattern>(mod);
+
+    vm->bind_func<1>(mod, "compile", [](VM* vm, pkpy::Args& args) {
+        return vm->new_object<RePattern>(_re_compile(vm, vm->PyStr_AS_C(args[0])));
+    });
 
     vm->bind_func<2>(mod, "match", [](VM* vm, pkpy::Args& args) {
-        const Str& pattern = vm->PyStr_AS_C(args[0]);
-        const Str& string = vm->PyStr_AS_C(args[1]);
-        return _regex_search(pattern, string, true, vm);
+        ReProgram_ prog = _re_compile(vm, vm->PyStr_AS_C(args[0]));
+        return _re_match(vm, *prog, args[1], true);
     });
 
     vm->bind_func<2>(mod, "search", [](VM* vm, pkpy::Args& args) {
-        const Str& pattern = vm->PyStr_AS_C(args[0]);
-        const Str& string = vm->PyStr_AS_C(args[1]);
-        return _regex_search(pattern, string, false, vm);
+        ReProgram_ prog = _re_compile(vm, vm->PyStr_AS_C(args[0]));
+        return _re_match(vm, *prog, args[1], false);
     });
 
     vm->bind_func<3>(mod, "sub", [](VM* vm, pkpy::Args& args) {
-        const Str& pattern = vm->PyStr_AS_C(args[0]);
-        const Str& repl = vm->PyStr_AS_C(args[1]);
-        const Str& string = vm->PyStr_AS_C(args[2]);
-        std::regex re(pattern);
-        return vm->PyStr(std::regex_replace(string, re, repl));
+        ReProgram_ prog = _re_compile(vm, vm->PyStr_AS_C(args[0]));
+        return _re_sub(vm, *prog, vm->PyStr_AS_C(args[1]), vm->PyStr_AS_C(args[2]));
     });
 
     vm->bind_func<2>(mod, "split", [](VM* vm, pkpy::Args& args) {
-        const Str& pattern = vm->PyStr_AS_C(args[0]);
-        const Str& string = vm->PyStr_AS_C(args[1]);
-        std::regex re(pattern);
-        std::sregex_token_iterator it(string.begin(), string.end(), re, -1);
-        std::sregex_token_iterator end;
-        pkpy::List vec;
-        for(; it != end; ++it){
-            vec.push_back(vm->PyStr(it->str()));
+        ReProgram_ prog = _re_compile(vm, vm->PyStr_AS_C(args[0]));
+        return _re_split(vm, *prog, vm->PyStr_AS_C(args[1]));
+    });
+
+    vm->bind_func<2>(mod, "findall", [](VM* vm, pkpy::Args& args) {
+        ReProgram_ prog = _re_compile(vm, vm->PyStr_AS_C(args[0]));
+        return _re_findall(vm, *prog, vm->PyStr_AS_C(args[1]));
+    });
+
+    vm->bind_func<2>(mod, "finditer", [](VM* vm, pkpy::Args& args) {
+        ReProgram_ prog = _re_compile(vm, vm->PyStr_AS_C(args[0]));
+        vm->check_type(args[1], vm->tp_str);
+        return vm->PyIter(pkpy::make_shared<BaseIter, ReMatchIter>(vm, args[1], prog));
+    });
+}
+
+void add_module_asyncio(VM* vm){
+    PyVar mod = vm->new_module("asyncio");
+    vm->register_class<Future>(mod);
+    vm->register_class<Task>(mod);
+    vm->register_class<EventLoop>(mod);
+    vm->setattr(mod, "_loop", vm->new_object<EventLoop>());
+
+    vm->bind_func<1>(mod, "run", [](VM* vm, pkpy::Args& args) {
+        EventLoop& loop = EventLoop::get(vm);
+        if(loop.running) vm->RuntimeError("asyncio.run() cannot be called from a running event loop");
+        PyVar task = loop.create_task(vm, args[0]);
+        loop.running = true;
+        try{
+            loop.run_until_complete(vm, OBJ_GET(Task, task).future);
+        }catch(...){
+            loop.clear();
+            throw;
         }
-        return vm->PyList(vec);
+        loop.clear();
+        return Future::result(vm, OBJ_GET(Task, task).future);
+    });
+
+    vm->bind_func<1>(mod, "create_task", [](VM* vm, pkpy::Args& args) {
+        return EventLoop::get(vm).create_task(vm, args[0]);
+    });
+
+    vm->bind_func<1>(mod, "ensure_future", [](VM* vm, pkpy::Args& args) {
+        if(args[0]->is_type(Task::_type(vm)) || args[0]->is_type(Future::_type(vm))) return args[0];
+        return EventLoop::get(vm).create_task(vm, args[0]);
+    });
+
+    vm->bind_func<1>(mod, "sleep", [](VM* vm, pkpy::Args& args) {
+        return EventLoop::get(vm).sleep(vm, vm->num_to_float(args[0]));
     });
+
+#ifdef PK_USE_THREADS
+    // a host operation finishing on another thread after `seconds`; for testing host futures
+    vm->bind_func<2>(mod, "host_timer", [](VM* vm, pkpy::Args& args) {
+        f64 seconds = vm->num_to_float(args[0]);
+        pkpy::Message value = pkpy::Message::from(vm, args[1]);
+        std::unique_ptr<pkpy::Completion> done;
+        PyVar fut = EventLoop::get(vm).expect(vm, done);
+        std::thread([seconds, value=std::move(value), done=std::move(done)]() mutable {
+            std::this_thread::sleep_for(std::chrono::duration<f64>(seconds));
+            done->resolve(std::move(value));
+        }).detach();
+        return fut;
+    });
+#endif
+
+    CodeObject_ code = vm->compile(kAsyncioCode, "asyncio.py", EXEC_MODE);
+    vm->_exec(code, mod, pkpy::make_shared<pkpy::NameDict>());
 }
 
 void add_module_random(VM* vm){
@@ -770,45 +1386,218 @@ class _PkExported{
 public:
     virtual ~_PkExported() = default;
     virtual void* get() = 0;
+    virtual const char* kind() const = 0;
+};
+
+// objects handed out by the C API, by the pointer the host sees.
+// A pointer that was deleted and then reused by a new allocation is indistinguishable
+// from the new one; only unknown and already deleted pointers are caught.
+class _PkExportTable {
+    emhash8::HashMap<void*, _PkExported*> _objects;
+    i64 _created = 0;
+    i64 _deleted = 0;
+    i64 _invalid = 0;       // pkpy_delete() on an unknown or already deleted pointer
+    std::mutex _mutex;
+public:
+    struct Stats {
+        std::map<std::string, i64> live;    // grouped by kind
+        i64 created, deleted, invalid;
+    };
+
+    void add(_PkExported* obj){
+        std::lock_guard<std::mutex> lock(_mutex);
+        _objects[obj->get()] = obj;
+        _created++;
+    }
+
+    bool remove(void* p){
+        _PkExported* obj;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _objects.find(p);
+            if(it == _objects.end()){ _invalid++; return false; }
+            obj = it->second;
+            _objects.erase(it);
+            _deleted++;
+        }
+        delete obj;
+        return true;
+    }
+
+    Stats stats(){
+        std::lock_guard<std::mutex> lock(_mutex);
+        Stats ret{{}, _created, _deleted, _invalid};
+        for(auto& [_, obj] : _objects) ret.live[obj->kind()]++;
+        return ret;
+    }
 };
 
-static std::vector<_PkExported*> _pk_lookup_table;
+static _PkExportTable _pk_export_table;
 
 template<typename T>
 class PkExported : public _PkExported{
     T* _ptr;
+    const char* _kind;
 public:
     template<typename... Args>
-    PkExported(Args&&... args) {
+    PkExported(const char* kind, Args&&... args) : _kind(kind) {
         _ptr = new T(std::forward<Args>(args)...);
-        _pk_lookup_table.push_back(this);
+        _pk_export_table.add(this);
     }
     
     ~PkExported() override { delete _ptr; }
     void* get() override { return _ptr; }
+    const char* kind() const override { return _kind; }
     operator T*() { return _ptr; }
 };
 
-#define PKPY_ALLOCATE(T, ...) *(new PkExported<T>(__VA_ARGS__))
+#define PKPY_ALLOCATE(T, ...) *(new PkExported<T>(#T, __VA_ARGS__))
+
+// a C string returned by the C API, freed by `pkpy_delete`
+class _PkExportedCStr : public _PkExported{
+    char* _ptr;
+public:
+    _PkExportedCStr(const std::string& s) {
+        _ptr = strdup(s.c_str());
+        _pk_export_table.add(this);
+    }
+
+    ~_PkExportedCStr() override { free(_ptr); }
+    void* get() override { return _ptr; }
+    const char* kind() const override { return "char*"; }
+    operator char*() { return _ptr; }
+};
+
+#define PKPY_STRDUP(s) ((char*)*(new _PkExportedCStr(s)))
+
+#ifdef PK_USE_THREADS
+extern "C" VM* pkpy_new_vm(bool use_stdio);
+extern "C" bool pkpy_delete(void* p);
+
+// declared after the export table, so it is stopped before the table goes away
+static std::unique_ptr<pkpy::WorkerPool> _pk_worker_pool;
+static std::once_flag _pk_worker_pool_once;
+
+pkpy::WorkerPool* _pk_get_worker_pool(){
+    std::call_once(_pk_worker_pool_once, [](){
+        int n = std::max(2, (int)std::thread::hardware_concurrency());
+        _pk_worker_pool = std::make_unique<pkpy::WorkerPool>(
+            n, [](){ return pkpy_new_vm(true); }, [](VM* vm){ pkpy_delete(vm); }
+        );
+    });
+    return _pk_worker_pool.get();
+}
+
+void add_module_concurrent(VM* vm){
+    PyVar mod = vm->new_module("concurrent");
+
+    vm->bind_func<1>(mod, "spawn", [](VM* vm, pkpy::Args& args) {
+        const Str& source = vm->PyStr_AS_C(args[0]);
+        return vm->PyInt(_pk_get_worker_pool()->spawn(source));
+    });
+
+    vm->bind_func<2>(mod, "send", [](VM* vm, pkpy::Args& args) {
+        pkpy::WorkerPool* pool = _pk_get_worker_pool();
+        i64 id = vm->PyInt_AS_C(args[0]);
+        pkpy::Message msg = pkpy::Message::from(vm, args[1]);
+        if(pool->mailbox(id) == nullptr) vm->ValueError("no actor with id " + std::to_string(id));
+        if(!pool->send(id, msg)){
+            if(pool->stopped()) vm->RuntimeError("worker pool is stopped");
+            vm->ValueError("actor " + std::to_string(id) + " has finished");
+        }
+        return vm->None;
+    });
+
+    vm->bind_func<0>(mod, "recv", [](VM* vm, pkpy::Args& args) {
+        pkpy::Message msg;
+        if(!_pk_get_worker_pool()->recv(pkpy::_actor_id, msg)) vm->RuntimeError("worker pool is stopped");
+        return msg.to(vm);
+    });
+
+    vm->bind_func<0>(mod, "current", CPP_LAMBDA(vm->PyInt(pkpy::_actor_id)));
+}
+
+void add_module_parallel(VM* vm){
+    PyVar mod = vm->new_module("parallel");
+
+    vm->bind_func<2>(mod, "map", {{"workers", vm->None}}, [](VM* vm, pkpy::Args& args) {
+        pkpy::WorkerPool* pool = _pk_get_worker_pool();
+        const PyVar& fn = args[0];
+        pkpy::List items = vm->PyList_AS_C(vm->call(vm->builtins->attr("list"), pkpy::one_arg(args[1])));
+        int workers = pool->size() + 1;
+        if(args[2] != vm->None){
+            workers = (int)vm->PyInt_AS_C(args[2]);
+            if(workers < 1) vm->ValueError("workers must be at least 1");
+        }
+        int n = items.size();
+        workers = std::min(workers, n);
+        pkpy::List out(n);
+        if(workers <= 1){
+            for(int i=0; i<n; i++) out[i] = vm->call(fn, pkpy::one_arg(items[i]));
+            return vm->PyList(std::move(out));
+        }
+
+        auto task = std::make_shared<pkpy::ParallelMap>();
+        task->fn = pkpy::Message::from(vm, fn);
+        for(const PyVar& x : items) task->items.push_back(pkpy::Message::from(vm, x));
+        task->results.resize(n);
+        task->remote.resize(n, 0);
+        task->chunk_size = std::max(1, n / (workers * 8));
+        task->n_chunks = (n + task->chunk_size - 1) / task->chunk_size;
+        for(int i=0; i<workers-1; i++){
+            if(!pool->submit([task](VM* vm){ task->work(vm); })) break;
+        }
+
+        // the caller works too, on its own objects
+        try{
+            int begin, end;
+            while(task->claim(begin, end)){
+                for(int i=begin; i<end; i++) out[i] = vm->call(fn, pkpy::one_arg(items[i]));
+            }
+        }catch(...){
+            task->failed = true;
+            task->closed = true;
+            throw;
+        }
+        task->close();
+        if(task->failed) vm->_error(task->error_type, task->error_msg);
+        for(int i=0; i<n; i++){
+            if(task->remote[i]) out[i] = task->results[i].to(vm);
+        }
+        return vm->PyList(std::move(out));
+    });
+}
+#endif
 
 
 extern "C" {
     __EXPORT
     /// Delete a pointer allocated by `pkpy_xxx_xxx`.
     /// It can be `VM*`, `REPL*`, `char*`, etc.
-    /// 
-    /// !!!
-    /// If the pointer is not allocated by `pkpy_xxx_xxx`, the behavior is undefined.
-    /// !!!
-    void pkpy_delete(void* p){
-        for(int i = 0; i < _pk_lookup_table.size(); i++){
-            if(_pk_lookup_table[i]->get() == p){
-                delete _pk_lookup_table[i];
-                _pk_lookup_table.erase(_pk_lookup_table.begin() + i);
-                return;
-            }
+    ///
+    /// Return false and do nothing if the pointer is unknown or already deleted.
+    bool pkpy_delete(void* p){
+        return _pk_export_table.remove(p);
+    }
+
+    __EXPORT
+    /// Statistics of pointers allocated by `pkpy_xxx_xxx`.
+    ///
+    /// Return a json like `{"live": {"VM": 1}, "created": 3, "deleted": 2, "invalid": 0, "handles": 0}`,
+    /// where `handles` is the number of live value handles.
+    char* pkpy_export_stats(){
+        _PkExportTable::Stats stats = _pk_export_table.stats();
+        StrStream ss;
+        ss << "{\"live\": {";
+        for(auto it = stats.live.begin(); it != stats.live.end(); ++it){
+            if(it != stats.live.begin()) ss << ", ";
+            ss << Str(it->first).escape(false) << ": " << it->second;
         }
-        free(p);
+        ss << "}, \"created\": " << stats.created;
+        ss << ", \"deleted\": " << stats.deleted;
+        ss << ", \"invalid\": " << stats.invalid;
+        ss << ", \"handles\": " << PkHandle::live_count << '}';
+        return PKPY_STRDUP(ss.str());
     }
 
     __EXPORT
@@ -827,7 +1616,7 @@ extern "C" {
         if(it == vm->_main->attr().end()) return nullptr;
         try{
             Str _repr = vm->PyStr_AS_C(vm->asRepr(it->second));
-            return strdup(_repr.c_str());
+            return PKPY_STRDUP(_repr);
         }catch(...){
             return nullptr;
         }
@@ -843,7 +1632,7 @@ extern "C" {
         if(ret == nullptr) return nullptr;
         try{
             Str _repr = vm->PyStr_AS_C(vm->asRepr(ret));
-            return strdup(_repr.c_str());
+            return PKPY_STRDUP(_repr);
         }catch(...){
             return nullptr;
         }
@@ -871,6 +1660,7 @@ extern "C" {
     /// Create a virtual machine.
     VM* pkpy_new_vm(bool use_stdio){
         VM* vm = PKPY_ALLOCATE(VM, use_stdio);
+        pkpy::_HeapScope heap_scope(vm->heap.get());
         init_builtins(vm);
         add_module_sys(vm);
         add_module_time(vm);
@@ -881,9 +1671,15 @@ extern "C" {
         add_module_random(vm);
         add_module_io(vm);
         add_module_os(vm);
+        add_module_asyncio(vm);
+#ifdef PK_USE_THREADS
+        add_module_concurrent(vm);
+        add_module_parallel(vm);
+#endif
 
         CodeObject_ code = vm->compile(kBuiltinsCode, "<builtins>", EXEC_MODE);
         vm->_exec(code, vm->builtins, pkpy::make_shared<pkpy::NameDict>());
+        vm->_make_builtins_immortal();
         return vm;
     }
 
@@ -894,7 +1690,7 @@ extern "C" {
     ///
     /// Return a json representing the result.
     char* pkpy_vm_read_output(VM* vm){
-        if(vm->use_stdio) return nullptr;
+        if(vm->use_stdio || vm->_output_redirected) return nullptr;
         StrStream* s_out = (StrStream*)(vm->_stdout);
         StrStream* s_err = (StrStream*)(vm->_stderr);
         Str _stdout = s_out->str();
@@ -903,7 +1699,88 @@ extern "C" {
         ss << '{' << "\"stdout\": " << _stdout.escape(false);
         ss << ", " << "\"stderr\": " << _stderr.escape(false) << '}';
         s_out->str(""); s_err->str("");
-        return strdup(ss.str().c_str());
+        return PKPY_STRDUP(ss.str());
+    }
+
+    __EXPORT
+    /// Stream the standard output and standard error of a virtual machine to callbacks,
+    /// instead of collecting them for `pkpy_vm_read_output`. The `vm->use_stdio` should be `false`.
+    ///
+    /// Output is passed in chunks of up to 8KB, when the buffer is full or flushed.
+    /// Buffers are flushed after each `pkpy_vm_exec`, `pkpy_vm_eval` or `pkpy_run`, and by `pkpy_vm_flush_output`.
+    /// If `max_bytes` is not negative, each stream stops passing output after that many bytes.
+    bool pkpy_vm_set_output_callbacks(VM* vm, PkOutputCallback f_stdout, PkOutputCallback f_stderr, void* userdata, i64 max_bytes){
+        if(vm->use_stdio || f_stdout == nullptr || f_stderr == nullptr) return false;
+        size_t limit = max_bytes < 0 ? SIZE_MAX : (size_t)max_bytes;
+        vm->flush_output();
+        delete vm->_stdout;
+        delete vm->_stderr;
+        vm->_stdout = new OutputStream(f_stdout, userdata, limit);
+        vm->_stderr = new OutputStream(f_stderr, userdata, limit);
+        vm->_output_redirected = true;
+        return true;
+    }
+
+    __EXPORT
+    /// Pass buffered output to the callbacks now.
+    void pkpy_vm_flush_output(VM* vm){
+        vm->flush_output();
+    }
+
+    __EXPORT
+    /// Limit each top-level run to `max_steps` preemption points (calls and backward jumps)
+    /// and `max_seconds` of wall time; -1 for no limit.
+    ///
+    /// When exhausted, a catchable `TimeoutError` is raised. Its handler gets 1024 more steps
+    /// without a time limit; if the run goes on after them, `TimeoutError` is raised again
+    /// past every handler and the run ends.
+    /// With `suspend`, the run is suspended instead and `pkpy_vm_exec` returns early;
+    /// `pkpy_vm_is_suspended` tells this apart and `pkpy_vm_resume` continues it.
+    /// A run inside a native call cannot be suspended; it gets one more budget, then raises as above.
+    void pkpy_vm_set_budget(VM* vm, i64 max_steps, double max_seconds, bool suspend){
+        vm->budget_steps = max_steps;
+        vm->budget_seconds = max_seconds;
+        vm->budget_suspends = suspend;
+    }
+
+    __EXPORT
+    /// Limit the bytes held by the objects of a vm; -1 for no limit.
+    /// Going over it raises `MemoryError` at the next preemption point,
+    /// or before a large allocation like `[0] * n` or `s.replace(a, b)`.
+    /// Its handler gets 1/8 of the limit as headroom to clean up, and the run must get down to half
+    /// the limit before it can catch another one; until then, `MemoryError` is raised past every handler
+    /// and the run ends.
+    ///
+    /// The limit is soft: temporaries inside a native call and results whose size is only known
+    /// once built, e.g. a regex `sub`, may briefly go over it.
+    void pkpy_vm_set_memory_limit(VM* vm, i64 max_bytes){
+        vm->heap->set_limit(max_bytes);
+    }
+
+    __EXPORT
+    i64 pkpy_vm_allocated_bytes(VM* vm){
+        return vm->heap->allocated;
+    }
+
+    __EXPORT
+    /// Raise `KeyboardInterrupt` in the current run, within its next 1024 preemption points.
+    /// Like `TimeoutError`, it can be caught once; a run still going 1024 steps later is ended.
+    /// Calling it while no run is active has no effect. It can be called from any thread.
+    void pkpy_vm_interrupt(VM* vm){
+        vm->interrupt();
+    }
+
+    __EXPORT
+    bool pkpy_vm_is_suspended(VM* vm){
+        return vm->is_suspended();
+    }
+
+    __EXPORT
+    /// Continue a suspended run with a fresh budget.
+    /// Return true if it is suspended again.
+    bool pkpy_vm_resume(VM* vm){
+        vm->resume();
+        return vm->is_suspended();
     }
 
     typedef i64 (*f_int_t)(char*);
@@ -945,7 +1822,8 @@ extern "C" {
                 PyVar x = vm->call(args[i], __json__);
                 ss << vm->PyStr_AS_C(x);
             }
-            char* packet = strdup(ss.str().c_str());
+            std::string _packet = ss.str();
+            char* packet = _packet.data();
             switch(ret_code){
                 case 'i': return vm->PyInt(f_int(packet));
                 case 'f': return vm->PyFloat(f_float(packet));
@@ -957,10 +1835,358 @@ extern "C" {
                 }
                 case 'N': f_None(packet); return vm->None;
             }
-            free(packet);
             UNREACHABLE();
             return vm->None;
         });
-        return strdup(f_header.c_str());
+        return PKPY_STRDUP(f_header);
+    }
+
+    __EXPORT
+    /// Add a reference to a handle, and return the handle to keep.
+    /// For an argument of a host function, that is a new handle to the same object.
+    PkHandle* pkpy_retain(PkHandle* h){
+        if(h->ref_count == PkHandle::kBorrowed) return new PkHandle(pkpy::_heap != nullptr ? pkpy::_heap->shared_from_this() : nullptr, h->obj);
+        h->ref_count++;
+        return h;
+    }
+
+    __EXPORT
+    /// Drop a reference to a handle. The handle is freed when no reference is left.
+    /// The arguments of a host function are not affected.
+    void pkpy_release(PkHandle* h){
+        if(h == nullptr || h->ref_count == PkHandle::kBorrowed) return;
+        if(--h->ref_count > 0) return;
+        std::shared_ptr<pkpy::Heap> heap = std::move(h->heap);
+        pkpy::_HeapScope heap_scope(heap.get());
+        delete h;
+    }
+
+    __EXPORT
+    PkHandle* pkpy_new_int(VM* vm, i64 value){ return _pk_new_handle(vm, [=](){ return vm->PyInt(value); }); }
+
+    __EXPORT
+    PkHandle* pkpy_new_float(VM* vm, f64 value){ return _pk_new_handle(vm, [=](){ return vm->PyFloat(value); }); }
+
+    __EXPORT
+    PkHandle* pkpy_new_bool(VM* vm, bool value){ return _pk_new_handle(vm, [=](){ return vm->PyBool(value); }); }
+
+    __EXPORT
+    /// The string is copied.
+    PkHandle* pkpy_new_str(VM* vm, const char* value, int size){ return _pk_new_handle(vm, [=](){ return vm->PyStr(Str(value, size)); }); }
+
+    __EXPORT
+    PkHandle* pkpy_new_voidp(VM* vm, void* value){ return _pk_new_handle(vm, [=](){ return vm->new_object<VoidP>(value); }); }
+
+    __EXPORT
+    PkHandle* pkpy_new_none(VM* vm){ return new PkHandle(vm->heap, vm->None); }
+
+    __EXPORT
+    /// Return false if the handle is not an `int`.
+    bool pkpy_to_int(VM* vm, PkHandle* h, i64* out){
+        if(!h->obj->is_type(vm->tp_int)) return false;
+        *out = vm->PyInt_AS_C(h->obj);
+        return true;
+    }
+
+    __EXPORT
+    /// Return false if the handle is not an `int` or `float`.
+    bool pkpy_to_float(VM* vm, PkHandle* h, f64* out){
+        if(h->obj->is_type(vm->tp_int)) *out = (f64)vm->PyInt_AS_C(h->obj);
+        else if(h->obj->is_type(vm->tp_float)) *out = vm->PyFloat_AS_C(h->obj);
+        else return false;
+        return true;
+    }
+
+    __EXPORT
+    /// Return false if the handle is not a `bool`.
+    bool pkpy_to_bool(VM* vm, PkHandle* h, bool* out){
+        if(!h->obj->is_type(vm->tp_bool)) return false;
+        *out = vm->PyBool_AS_C(h->obj);
+        return true;
+    }
+
+    __EXPORT
+    /// Return false if the handle is not a `str`.
+    /// The view is not copied and stays valid while the handle is alive.
+    bool pkpy_to_str_view(VM* vm, PkHandle* h, const char** out, int* size){
+        if(!h->obj->is_type(vm->tp_str)) return false;
+        const Str& s = vm->PyStr_AS_C(h->obj);
+        *out = s.c_str();
+        *size = (int)s.size();
+        return true;
+    }
+
+    __EXPORT
+    /// Return false if the handle is not a `void_p`.
+    bool pkpy_to_voidp(VM* vm, PkHandle* h, void** out){
+        if(!h->obj->is_type(VoidP::_type(vm))) return false;
+        *out = OBJ_GET(VoidP, h->obj).ptr;
+        return true;
+    }
+
+    __EXPORT
+    /// Make the running host function raise `RuntimeError` when it returns.
+    void pkpy_set_error(VM* vm, const char* msg){
+        _pk_host_error = msg;
+        _pk_host_error_set = true;
+    }
+
+    __EXPORT
+    /// Forget the error of a failed C API call made by the running host function, once it is handled.
+    void pkpy_clear_error(VM* vm){
+        _pk_pending_error = {};
+    }
+
+    /// A host function called with borrowed argument handles, valid during the call;
+    /// keep one with `pkpy_retain`, which returns the handle to keep.
+    /// The returned handle is owned by the vm and may be one of `argv`; `nullptr` means `None`.
+    /// If a C API call it made failed, returning `nullptr` raises that error unless it was cleared.
+    typedef PkHandle* (*pkpy_native_fn)(VM* vm, PkHandle** argv, int argc, void* userdata);
+
+    __EXPORT
+    /// Bind a host function without marshalling its arguments.
+    /// `argc` is the number of arguments, or -1 for any.
+    void pkpy_vm_bind_native(VM* vm, const char* mod, const char* name, int argc, pkpy_native_fn fn, void* userdata){
+        PyVar obj = vm->_modules.contains(mod) ? vm->_modules[mod] : vm->new_module(mod);
+        vm->bind_func<-1>(obj, name, [argc, fn, userdata](VM* vm, pkpy::Args& args){
+            if(argc >= 0 && args.size() != argc){
+                vm->TypeError("expected " + std::to_string(argc) + " arguments, but got " + std::to_string(args.size()));
+            }
+            _PkArgv argv(args);
+            _PkPendingError outer = std::move(_pk_pending_error);      // of a host function up the stack
+            _pk_pending_error = {};
+            PkHandle* ret = fn(vm, argv.data(), args.size(), userdata);
+            _PkPendingError error = std::move(_pk_pending_error);
+            _pk_pending_error = std::move(outer);
+            PyVar val = ret != nullptr ? ret->obj : vm->None;
+            pkpy_release(ret);      // before argv goes away, since it may be one of them
+            if(ret == nullptr && !error.empty()){
+                _pk_host_error_set = false;
+                error.raise(vm);
+            }
+            if(_pk_host_error_set){
+                _pk_host_error_set = false;
+                vm->RuntimeError(std::move(_pk_host_error));
+            }
+            return val;
+        });
+    }
+
+    __EXPORT
+    /// Get a global variable of the `__main__` module.
+    /// If the variable is not found, return `nullptr`.
+    PkHandle* pkpy_get_global(VM* vm, const char* name){
+        PyVar* val = vm->_main->attr().try_get(name);
+        return val != nullptr ? new PkHandle(vm->heap, *val) : nullptr;
+    }
+
+    __EXPORT
+    /// Set a global variable of the `__main__` module.
+    void pkpy_set_global(VM* vm, const char* name, PkHandle* value){
+        vm->setattr(vm->_main, name, value->obj);
+    }
+
+    __EXPORT
+    /// Call a callable with positional arguments. The arguments are not released.
+    ///
+    /// If there is any error, return `nullptr`.
+    PkHandle* pkpy_call(VM* vm, PkHandle* callable, PkHandle** argv, int argc){
+        return _pk_handle(vm, _pk_guard(vm, [=](){
+            pkpy::Args args(argc);
+            for(int i=0; i<argc; i++) args[i] = argv[i]->obj;
+            return vm->call(callable->obj, std::move(args));
+        }));
+    }
+
+    __EXPORT
+    /// Get an attribute. If there is any error, return `nullptr`.
+    PkHandle* pkpy_getattr(VM* vm, PkHandle* obj, const char* name){
+        return _pk_handle(vm, _pk_guard(vm, [=](){ return vm->getattr(obj->obj, name); }));
+    }
+
+    __EXPORT
+    /// Create a list from the given items. The items are not released.
+    PkHandle* pkpy_new_list(VM* vm, PkHandle** items, int size){
+        return _pk_new_handle(vm, [=](){
+            pkpy::List list(size);
+            for(int i=0; i<size; i++) list[i] = items[i]->obj;
+            return vm->PyList(std::move(list));
+        });
+    }
+
+    __EXPORT
+    /// Create an empty dict.
+    PkHandle* pkpy_new_dict(VM* vm){
+        return _pk_handle(vm, _pk_guard(vm, [=](){ return vm->call(vm->builtins->attr("dict")); }));
+    }
+
+    __EXPORT
+    /// `obj[key]`. If there is any error, return `nullptr`.
+    PkHandle* pkpy_getitem(VM* vm, PkHandle* obj, PkHandle* key){
+        return _pk_handle(vm, _pk_guard(vm, [=](){
+            return vm->call(obj->obj, __getitem__, pkpy::one_arg(key->obj));
+        }));
+    }
+
+    __EXPORT
+    /// `obj[key] = value`. Return false if there is any error.
+    bool pkpy_setitem(VM* vm, PkHandle* obj, PkHandle* key, PkHandle* value){
+        return _pk_guard(vm, [=](){
+            return vm->call(obj->obj, __setitem__, pkpy::two_args(key->obj, value->obj));
+        }) != nullptr;
+    }
+
+    __EXPORT
+    /// Set an attribute. Return false if there is any error.
+    bool pkpy_setattr(VM* vm, PkHandle* obj, const char* name, PkHandle* value){
+        return _pk_guard(vm, [=](){
+            vm->setattr(obj->obj, name, value->obj);
+            return vm->None;
+        }) != nullptr;
+    }
+
+    __EXPORT
+    /// Create a module that is not registered for `import`.
+    /// It can be passed to `pkpy_run` as a set of globals.
+    PkHandle* pkpy_new_module(VM* vm, const char* name){
+        return _pk_new_handle(vm, [=](){
+            PyVar obj = vm->new_object(vm->tp_module, DUMMY_VAL);
+            vm->setattr(obj, __name__, vm->PyStr(name));
+            return obj;
+        });
+    }
+
+    __EXPORT
+    /// Compile a source into a code object, which can be run by `pkpy_run` repeatedly.
+    /// `mode` is 0 for exec and 1 for eval.
+    ///
+    /// If there is any error, return `nullptr`. Otherwise, free it by `pkpy_delete`.
+    CodeObject_* pkpy_compile(VM* vm, const char* source, const char* filename, int mode){
+        if(mode != EXEC_MODE && mode != EVAL_MODE) return nullptr;
+        try{
+            return PKPY_ALLOCATE(CodeObject_, vm->compile(source, filename, (CompileMode)mode));
+        }catch(const pkpy::Exception& e){
+            *vm->_stderr << e.summary() << '\n';
+            vm->flush_output();
+            return nullptr;
+        }
+    }
+
+    __EXPORT
+    /// Run a compiled code object in the given module.
+    /// If `module` is `nullptr`, a fresh module is used, so no globals are left from previous runs.
+    ///
+    /// Return the result (`None` in exec mode), or `nullptr` if there is any error.
+    PkHandle* pkpy_run(VM* vm, CodeObject_* code, PkHandle* module){
+        PyVar _module;
+        if(module != nullptr){
+            if(!module->obj->is_type(vm->tp_module)) return nullptr;
+            _module = module->obj;
+        }else{
+            _module = vm->new_object(vm->tp_module, DUMMY_VAL);
+            vm->setattr(_module, __name__, vm->PyStr("__main__"));
+        }
+        return _pk_handle(vm, _pk_guard(vm, [&](){
+            return vm->_exec(*code, _module, pkpy::make_shared<pkpy::NameDict>());
+        }));
+    }
+
+    __EXPORT
+    /// `len(obj)`. Return -1 if there is any error.
+    i64 pkpy_len(VM* vm, PkHandle* obj){
+        PyVarOrNull ret = _pk_guard(vm, [=](){ return vm->call(obj->obj, __len__); });
+        return ret != nullptr ? vm->PyInt_AS_C(ret) : -1;
+    }
+
+    __EXPORT
+    /// Create an `asyncio.Future` for a host operation.
+    /// Scripts `await` it; the host completes it later from the thread running the vm,
+    /// e.g. inside a host function called by another task.
+    PkHandle* pkpy_new_future(VM* vm){
+        return _pk_handle(vm, _pk_guard(vm, [=](){ return vm->new_object<Future>(); }));
+    }
+
+    __EXPORT
+    /// Complete a future; the tasks awaiting it resume with `value`.
+    /// Return false if there is any error, e.g. the future is already done.
+    bool pkpy_future_set_result(VM* vm, PkHandle* future, PkHandle* value){
+        return _pk_guard(vm, [=](){
+            vm->py_cast<Future>(future->obj);
+            Future::set(vm, future->obj, Future::DONE, value->obj);
+            return vm->None;
+        }) != nullptr;
+    }
+
+    __EXPORT
+    /// Create a future for a host operation that finishes on another thread.
+    /// A host function returns it and scripts `await` it, so the vm keeps running other tasks meanwhile.
+    ///
+    /// `*completion` must be used exactly once, from any thread, by `pkpy_complete_xxx`,
+    /// which also frees it.
+    PkHandle* pkpy_new_host_future(VM* vm, pkpy::Completion** completion){
+        std::unique_ptr<pkpy::Completion> done;
+        PkHandle* ret = _pk_handle(vm, _pk_guard(vm, [&](){ return EventLoop::get(vm).expect(vm, done); }));
+        *completion = done.release();
+        return ret;
+    }
+
+    __EXPORT
+    void pkpy_complete_none(pkpy::Completion* completion){
+        completion->resolve(pkpy::Message());
+        delete completion;
+    }
+
+    __EXPORT
+    void pkpy_complete_int(pkpy::Completion* completion, i64 value){
+        pkpy::Message msg;
+        msg.kind = pkpy::Message::INT;
+        msg.i = value;
+        completion->resolve(std::move(msg));
+        delete completion;
+    }
+
+    __EXPORT
+    void pkpy_complete_float(pkpy::Completion* completion, f64 value){
+        pkpy::Message msg;
+        msg.kind = pkpy::Message::FLOAT;
+        msg.f = value;
+        completion->resolve(std::move(msg));
+        delete completion;
+    }
+
+    __EXPORT
+    /// The string is copied.
+    void pkpy_complete_str(pkpy::Completion* completion, const char* value, int size){
+        pkpy::Message msg;
+        msg.kind = pkpy::Message::STR;
+        msg.s = std::string(value, size);
+        completion->resolve(std::move(msg));
+        delete completion;
+    }
+
+    __EXPORT
+    /// Fail the future; awaiting it raises an error of the given type, e.g. `"IOError"`.
+    void pkpy_complete_error(pkpy::Completion* completion, const char* type, const char* msg){
+        completion->reject(type, msg);
+        delete completion;
+    }
+
+    __EXPORT
+    /// Give up on the operation; tasks awaiting the future raise `CancelledError`.
+    /// A host future that is never completed and no longer awaited is dropped by the loop anyway.
+    void pkpy_complete_cancel(pkpy::Completion* completion){
+        completion->reject("CancelledError", "the host operation was cancelled");
+        delete completion;
+    }
+
+    __EXPORT
+    /// Fail a future; awaiting it raises an error of the given type, e.g. `"IOError"`.
+    /// Return false if there is any error, e.g. the future is already done.
+    bool pkpy_future_set_exception(VM* vm, PkHandle* future, const char* type, const char* msg){
+        return _pk_guard(vm, [=](){
+            vm->py_cast<Future>(future->obj);
+            Future::set(vm, future->obj, Future::FAILED, vm->PyException(pkpy::Exception(type, msg)));
+            return vm->None;
+        }) != nullptr;
     }
 }
\ No newline at end of file
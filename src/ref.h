@@ -6,6 +6,8 @@ struct BaseRef {
     virtual PyVar get(VM*, Frame*) const = 0;
     virtual void set(VM*, Frame*, PyVar) const = 0;
     virtual void del(VM*, Frame*) const = 0;
+    // the variable slot this ref writes to, if it has one
+    virtual PyVar* slot(VM*, Frame*) const { return nullptr; }
     virtual ~BaseRef() = default;
 };
 
@@ -17,14 +19,15 @@ enum NameScope {
 };
 
 struct NameRef : BaseRef {
-    std::pair<Str, NameScope>* _pair;
-    inline const Str& name() const { return _pair->first; }
+    std::pair<StrName, NameScope>* _pair;
+    inline StrName name() const { return _pair->first; }
     inline NameScope scope() const { return _pair->second; }
-    NameRef(std::pair<Str, NameScope>& pair) : _pair(&pair) {}
+    NameRef(std::pair<StrName, NameScope>& pair) : _pair(&pair) {}
 
     PyVar get(VM* vm, Frame* frame) const;
     void set(VM* vm, Frame* frame, PyVar val) const;
     void del(VM* vm, Frame* frame) const;
+    PyVar* slot(VM* vm, Frame* frame) const override;
 };
 
 struct AttrRef : BaseRef {
@@ -33,13 +33,25 @@ public:
     using std::vector<PyVar>::vector;
 };
 
-typedef emhash8::HashMap<Str, PyVar> NameDict;
+typedef emhash8::HashMap<StrName, PyVar> NameDict;
+
+class Bytes: public std::string {
+public:
+    using std::string::string;
+    Bytes(const std::string& s) : std::string(s) {}
+    Bytes(std::string&& s) : std::string(std::move(s)) {}
+};
 
 }
 
 namespace pkpy {
     const int kMaxPoolSize = 10;
-    static THREAD_LOCAL std::vector<PyVar*>* _args_pool = new std::vector<PyVar*>[kMaxPoolSize];
+    struct _ArgsPool {
+        std::vector<PyVar*> _a[kMaxPoolSize];
+        inline std::vector<PyVar*>& operator[](int n) noexcept { return _a[n]; }
+        ~_ArgsPool(){ for(auto& v : _a) for(PyVar* p : v) delete[] p; }
+    };
+    static THREAD_LOCAL _ArgsPool _args_pool;
 
     class Args {
         PyVar* _args;
@@ -159,4 +171,44 @@ namespace pkpy {
     }
 
     typedef Args Tuple;
-}
\ No newline at end of file
+
+    // bounded map that evicts the least recently used entry
+    template<typename K, typename V>
+    class LRUCache {
+        typedef std::list<std::pair<K, V>> _List;
+        _List _items;
+        emhash8::HashMap<K, typename _List::iterator> _map;
+        size_t _capacity;
+    public:
+        LRUCache(size_t capacity) : _capacity(capacity) {}
+
+        V* get(const K& key){
+            auto it = _map.find(key);
+            if(it == _map.end()) return nullptr;
+            _items.splice(_items.begin(), _items, it->second);
+            return &it->second->second;
+        }
+
+        V& put(const K& key, V value){
+            V* p = get(key);
+            if(p != nullptr){
+                *p = std::move(value);
+                return *p;
+            }
+            _items.emplace_front(key, std::move(value));
+            _map[key] = _items.begin();
+            if(_items.size() > _capacity){
+                _map.erase(_items.back().first);
+                _items.pop_back();
+            }
+            return _items.front().second;
+        }
+
+        inline size_t size() const { return _items.size(); }
+
+        void clear(){
+            _map.clear();
+            _items.clear();
+        }
+    };
+}
@@ -5,16 +5,15 @@
 typedef std::stringstream StrStream;
 
 class Str : public std::string {
-    mutable std::vector<uint16_t>* _u8_index = nullptr;
+    mutable std::vector<uint32_t>* _u8_index = nullptr;
     mutable bool hash_initialized = false;
     mutable size_t _hash;
 
     void utf8_lazy_init() const{
         if(_u8_index != nullptr) return;
-        _u8_index = new std::vector<uint16_t>();
+        _u8_index = new std::vector<uint32_t>();
         _u8_index->reserve(size());
-        if(size() > 65535) throw std::runtime_error("str has more than 65535 bytes.");
-        for(uint16_t i = 0; i < size(); i++){
+        for(uint32_t i = 0; i < size(); i++){
             // https://stackoverflow.com/questions/3911536/utf-8-unicode-whats-with-0xc0-and-0x80
             if((at(i) & 0xC0) != 0x80) _u8_index->push_back(i);
         }
@@ -24,9 +23,10 @@ public:
     Str(const char* s) : std::string(s) {}
     Str(const char* s, size_t n) : std::string(s, n) {}
     Str(const std::string& s) : std::string(s) {}
+    Str(std::string&& s) : std::string(std::move(s)) {}
     Str(const Str& s) : std::string(s) {
         if(s._u8_index != nullptr){
-            _u8_index = new std::vector<uint16_t>(*s._u8_index);
+            _u8_index = new std::vector<uint32_t>(*s._u8_index);
         }
         if(s.hash_initialized){
             _hash = s._hash;
@@ -118,7 +118,7 @@ public:
         this->std::string::operator=(s);
         delete _u8_index;
         if(s._u8_index != nullptr){
-            _u8_index = new std::vector<uint16_t>(*s._u8_index);
+            _u8_index = new std::vector<uint32_t>(*s._u8_index);
         }
         this->hash_initialized = s.hash_initialized;
         this->_hash = s._hash;
@@ -135,6 +135,16 @@ public:
         return *this;
     }
 
+    // appending invalidates the cached hash and utf8 index
+    template<typename T>
+    Str& operator+=(const T& s){
+        this->std::string::operator+=(s);
+        delete _u8_index;
+        _u8_index = nullptr;
+        hash_initialized = false;
+        return *this;
+    }
+
     ~Str(){ delete _u8_index;}
 };
 
@@ -147,36 +157,127 @@ namespace std {
     };
 }
 
-const Str __class__ = Str("__class__");
-const Str __base__ = Str("__base__");
-const Str __new__ = Str("__new__");
-const Str __iter__ = Str("__iter__");
-const Str __str__ = Str("__str__");
-const Str __repr__ = Str("__repr__");
-const Str __getitem__ = Str("__getitem__");
-const Str __setitem__ = Str("__setitem__");
-const Str __delitem__ = Str("__delitem__");
-const Str __contains__ = Str("__contains__");
-const Str __init__ = Str("__init__");
-const Str __json__ = Str("__json__");
-const Str __name__ = Str("__name__");
-const Str __len__ = Str("__len__");
-
-const Str m_append = Str("append");
-const Str m_eval = Str("eval");
-const Str m_self = Str("self");
-const Str __enter__ = Str("__enter__");
-const Str __exit__ = Str("__exit__");
-
-const Str CMP_SPECIAL_METHODS[] = {
+// An interned identifier. All StrNames with the same content point to the same
+// entry of a process-wide table, so equality is a pointer compare and the hash is precomputed.
+// The table is shared by every vm, as names like `__init__` are; entries are never freed,
+// so names built from data (`setattr(o, 'k' + str(i), v)`) stay for the life of the process.
+struct StrName {
+    const Str* _s;
+
+    StrName(): _s(_empty()) {}
+    StrName(const char* s): _s(_intern(s)) {}
+    StrName(const std::string& s): _s(_intern(s)) {}
+    StrName(const Str& s): _s(_intern(s)) {}
+
+    inline const Str& str() const noexcept { return *_s; }
+    inline size_t hash() const noexcept { return _s->hash(); }
+    inline bool empty() const noexcept { return _s->empty(); }
+
+    inline bool operator==(const StrName& other) const noexcept { return _s == other._s; }
+    inline bool operator!=(const StrName& other) const noexcept { return _s != other._s; }
+    inline bool operator<(const StrName& other) const noexcept { return *_s < *other._s; }
+
+    // open addressing over published entries; readers never lock, and a full table is
+    // replaced by a larger copy. Replaced tables are kept, since readers may still probe them
+    struct _Table {
+        size_t mask;
+        size_t count = 0;
+        std::unique_ptr<std::atomic<const Str*>[]> slots;
+        _Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<const Str*>[capacity]) {
+            for(size_t i=0; i<capacity; i++) slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        const Str* find(const std::string& s, size_t h) const {
+            for(size_t i = h & mask; ; i = (i + 1) & mask){
+                const Str* p = slots[i].load(std::memory_order_acquire);
+                if(p == nullptr) return nullptr;
+                if(p->hash() == h && *p == s) return p;
+            }
+        }
+
+        void put(const Str* p){
+            size_t i = p->hash() & mask;
+            while(slots[i].load(std::memory_order_relaxed) != nullptr) i = (i + 1) & mask;
+            slots[i].store(p, std::memory_order_release);
+            count++;
+        }
+    };
+
+    static const Str* _intern(const std::string& s){
+        static _Table _first(1024);
+        static std::atomic<_Table*> _current{&_first};
+        static std::mutex _mutex;
+        static std::vector<std::unique_ptr<_Table>> _larger;
+        size_t h = std::hash<std::string>()(s);
+        const Str* p = _current.load(std::memory_order_acquire)->find(s, h);
+        if(p != nullptr) return p;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _Table* table = _current.load(std::memory_order_relaxed);
+        p = table->find(s, h);
+        if(p != nullptr) return p;
+        Str* entry = new Str(s);
+        entry->hash();      // cached before it is published, so readers never write it
+        if((table->count + 1) * 2 > table->mask + 1){
+            auto larger = std::make_unique<_Table>((table->mask + 1) * 2);
+            for(size_t i=0; i<=table->mask; i++){
+                const Str* q = table->slots[i].load(std::memory_order_relaxed);
+                if(q != nullptr) larger->put(q);
+            }
+            table = larger.get();
+            _larger.push_back(std::move(larger));
+        }
+        table->put(entry);
+        _current.store(table, std::memory_order_release);
+        return entry;
+    }
+
+    static const Str* _empty(){
+        static const Str* p = _intern("");
+        return p;
+    }
+};
+
+namespace std {
+    template<>
+    struct hash<StrName> {
+        inline std::size_t operator()(const StrName& s) const {
+            return s.hash();
+        }
+    };
+}
+
+const StrName __class__ = StrName("__class__");
+const StrName __base__ = StrName("__base__");
+const StrName __new__ = StrName("__new__");
+const StrName __iter__ = StrName("__iter__");
+const StrName __str__ = StrName("__str__");
+const StrName __repr__ = StrName("__repr__");
+const StrName __getitem__ = StrName("__getitem__");
+const StrName __setitem__ = StrName("__setitem__");
+const StrName __delitem__ = StrName("__delitem__");
+const StrName __contains__ = StrName("__contains__");
+const StrName __init__ = StrName("__init__");
+const StrName __json__ = StrName("__json__");
+const StrName __name__ = StrName("__name__");
+const StrName __len__ = StrName("__len__");
+const StrName __slots__ = StrName("__slots__");
+
+const StrName m_append = StrName("append");
+const StrName m_eval = StrName("eval");
+const StrName m_self = StrName("self");
+const StrName __enter__ = StrName("__enter__");
+const StrName __exit__ = StrName("__exit__");
+
+const StrName CMP_SPECIAL_METHODS[] = {
     "__lt__", "__le__", "__eq__", "__ne__", "__gt__", "__ge__"
 };
 
-const Str BINARY_SPECIAL_METHODS[] = {
+const StrName BINARY_SPECIAL_METHODS[] = {
     "__add__", "__sub__", "__mul__", "__truediv__", "__floordiv__", "__mod__", "__pow__"
 };
 
-const Str BITWISE_SPECIAL_METHODS[] = {
+const StrName BITWISE_SPECIAL_METHODS[] = {
     "__lshift__", "__rshift__", "__and__", "__or__", "__xor__"
 };
 
@@ -190,3 +291,68 @@ bool is_unicode_Lo_char(uint32_t c) {
     if(index < 0) return false;
     return c >= kLoRangeA[index] && c <= kLoRangeB[index];
 }
+
+// shortest repr that round-trips, laid out the way Python does:
+// scientific notation if the exponent is < -4 or >= 16, and ".0" for integral values
+Str float_repr(f64 val){
+    if(std::isnan(val)) return "nan";
+    if(std::isinf(val)) return val > 0 ? "inf" : "-inf";
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), val, std::chars_format::scientific);
+    std::string_view sci(buf, res.ptr - buf);       // e.g. "-1.2345e+17"
+    size_t e_pos = sci.find('e');
+    int exp = 0;
+    const char* exp_begin = buf + e_pos + (buf[e_pos + 1] == '+' ? 2 : 1);
+    std::from_chars(exp_begin, res.ptr, exp);
+    if(exp < -4 || exp >= 16) return Str(std::string(sci));
+
+    std::string digits;
+    bool neg = sci[0] == '-';
+    for(size_t i = neg ? 1 : 0; i < e_pos; i++){
+        if(sci[i] != '.') digits += sci[i];
+    }
+    std::string ret = neg ? "-" : "";
+    if(exp < 0){
+        ret += "0.";
+        ret.append(-exp - 1, '0');
+        ret += digits;
+    }else if((int)digits.size() <= exp + 1){
+        ret += digits;
+        ret.append(exp + 1 - digits.size(), '0');
+        ret += ".0";
+    }else{
+        ret.append(digits, 0, exp + 1);
+        ret += '.';
+        ret.append(digits, exp + 1);
+    }
+    return Str(std::move(ret));
+}
+
+inline std::string_view _strip_number(std::string_view s){
+    while(!s.empty() && isspace((unsigned char)s.front())) s.remove_prefix(1);
+    while(!s.empty() && isspace((unsigned char)s.back())) s.remove_suffix(1);
+    if(s.size() > 1 && s[0] == '+' && s[1] != '-') s.remove_prefix(1);
+    return s;
+}
+
+// the whole string must be consumed; surrounding spaces and a leading '+' are allowed
+std::errc parse_int(std::string_view s, i64& out, int base=10){
+    s = _strip_number(s);
+    auto res = std::from_chars(s.data(), s.data() + s.size(), out, base);
+    if(res.ec != std::errc()) return res.ec;
+    if(s.empty() || res.ptr != s.data() + s.size()) return std::errc::invalid_argument;
+    return std::errc();
+}
+
+std::errc parse_float(std::string_view s, f64& out){
+    s = _strip_number(s);
+    auto res = std::from_chars(s.data(), s.data() + s.size(), out);
+    if(s.empty() || res.ptr != s.data() + s.size()) return std::errc::invalid_argument;
+    if(res.ec == std::errc::result_out_of_range){
+        // from_chars leaves `out` untouched, strtod gives inf or 0 like Python
+        out = strtod(std::string(s).c_str(), nullptr);
+    }else if(res.ec != std::errc()){
+        return res.ec;
+    }
+    return std::errc();
+}
@@ -11,15 +11,99 @@
     inline PyVar Py##type(const ctype& value) { return new_object(ptype, value);} \
     inline PyVar Py##type(ctype&& value) { return new_object(ptype, std::move(value));}
 
+typedef void (*PkOutputCallback)(const char* data, size_t size, void* userdata);
+
+// a fixed buffer that hands output to a callback in chunks
+class OutputSink : public std::streambuf {
+    static const size_t kBufferSize = 8192;
+    char _buf[kBufferSize];
+    PkOutputCallback _callback;
+    void* _userdata;
+    size_t _limit;          // bytes beyond the limit are dropped
+    size_t _written = 0;
+
+    void _emit(const char* p, size_t n){
+        if(_written >= _limit) return;
+        n = std::min(n, _limit - _written);
+        _written += n;
+        _callback(p, n, _userdata);
+    }
+
+    void _flush(){
+        if(pptr() > pbase()) _emit(pbase(), pptr() - pbase());
+        setp(_buf, _buf + kBufferSize);
+    }
+protected:
+    int_type overflow(int_type c) override {
+        _flush();
+        if(!traits_type::eq_int_type(c, traits_type::eof())){
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        if(n <= epptr() - pptr()){
+            memcpy(pptr(), s, n);
+            pbump((int)n);
+        }else{
+            _flush();
+            if(n < kBufferSize){
+                memcpy(pptr(), s, n);
+                pbump((int)n);
+            }else{
+                _emit(s, n);
+            }
+        }
+        return n;
+    }
+
+    int sync() override {
+        _flush();
+        return 0;
+    }
+public:
+    OutputSink(PkOutputCallback callback, void* userdata, size_t limit)
+        : _callback(callback), _userdata(userdata), _limit(limit) {
+        setp(_buf, _buf + kBufferSize);
+    }
+
+    size_t written() const { return _written; }
+};
+
+class OutputStream : public std::ostream {
+    OutputSink _sink;
+public:
+    OutputStream(PkOutputCallback callback, void* userdata, size_t limit)
+        : std::ostream(nullptr), _sink(callback, userdata, limit) { rdbuf(&_sink); }
+    ~OutputStream(){ _sink.pubsync(); }
+};
+
+inline void _write_stdio(const char* data, size_t size, void* fp){
+    fwrite(data, 1, size, (FILE*)fp);
+    fflush((FILE*)fp);
+}
+
 class Generator;
 
 class VM {
 public:
+    std::shared_ptr<pkpy::Heap> heap = std::make_shared<pkpy::Heap>();    // first, so it outlives every object of the vm
+    // made current by ~VM() for the members freed after it, and restored once they are
+    struct _HeapRestore {
+        pkpy::Heap* prev = nullptr;
+        ~_HeapRestore(){ pkpy::_heap = prev; }
+    } _heap_restore;
+    // the empty shape that the shapes of instances of each python class grow from, by type index
+    std::vector<std::unique_ptr<pkpy::Shape>> _root_shapes;
     std::stack< std::unique_ptr<Frame> > callstack;
     PyVar _py_op_call;
     PyVar _py_op_yield;
+    PyVar _py_op_preempt;
     std::vector<PyVar> _all_types;
-    // PyVar _ascii_str_pool[128];
+    PyVar _ascii_str_pool[128];
+    PyVar _empty_str;
 
     PyVar run_frame(Frame* frame);
 
@@ -29,6 +113,7 @@ public:
     PyVar None, True, False, Ellipsis;
 
     bool use_stdio;
+    bool _output_redirected = false;    // _stdout/_stderr are `OutputStream`s instead of `StrStream`s
     std::ostream* _stdout;
     std::ostream* _stderr;
     
@@ -37,18 +122,43 @@ public:
 
     int recursionlimit = 1000;
 
+    // compiled code of eval() and exec(), keyed by source
+    pkpy::LRUCache<Str, CodeObject_> _eval_cache{256};
+    pkpy::LRUCache<Str, CodeObject_> _exec_cache{256};
+    i64 _code_cache_hits = 0;
+    i64 _code_cache_misses = 0;
+
+    // execution budget of each top-level run, counted at calls and backward jumps; -1 for no limit
+    i64 budget_steps = -1;
+    f64 budget_seconds = -1;
+    bool budget_suspends = false;   // when exhausted, suspend the run for `resume()` instead of raising TimeoutError
+    std::atomic<bool> _interrupted{false};
+    static constexpr i64 kCheckSlice = 1024;    // preemption points between slow checks
+    i64 _ticks = kCheckSlice;
+    i64 _slice = kCheckSlice;
+    i64 _steps_left = -1;
+    f64 _deadline = -1;
+    bool _grace = false;
+    const char* _stopping = nullptr;        // the error that stops the run, raised past handlers from the next slice on
+    const char* _stopping_msg = nullptr;
+    int _exec_depth = 0;
+    bool _suspendable = false;
+    i64 _suspended_base = -1;       // base frame id of a suspended run
+
     VM(bool use_stdio){
         this->use_stdio = use_stdio;
         if(use_stdio){
-            this->_stdout = &std::cout;
-            this->_stderr = &std::cerr;
+            this->_stdout = new OutputStream(_write_stdio, stdout, SIZE_MAX);
+            this->_stderr = new OutputStream(_write_stdio, stderr, SIZE_MAX);
+            this->_stderr->tie(this->_stdout);
         }else{
             this->_stdout = new StrStream();
             this->_stderr = new StrStream();
         }
 
+        heap->_ticks = &_ticks;
+        pkpy::_HeapScope heap_scope(heap.get());
         init_builtin_types();
-        // for(int i=0; i<128; i++) _ascii_str_pool[i] = new_object(tp_str, std::string(1, (char)i));
     }
 
     PyVar asStr(const PyVar& obj){
@@ -93,7 +203,7 @@ public:
         return call(_t(tp_list), pkpy::one_arg(iterable));
     }
 
-    PyVar fast_call(const Str& name, pkpy::Args&& args){
+    PyVar fast_call(StrName name, pkpy::Args&& args){
         PyObject* cls = _t(args[0]).get();
         while(cls != None.get()) {
             PyVar* val = cls->attr().try_get(name);
@@ -116,11 +226,11 @@ public:
 
     template<typename ArgT>
     inline std::enable_if_t<std::is_same_v<RAW(ArgT), pkpy::Args>, PyVar>
-    call(const PyVar& obj, const Str& func, ArgT&& args){
+    call(const PyVar& obj, StrName func, ArgT&& args){
         return call(getattr(obj, func), std::forward<ArgT>(args), pkpy::no_arg(), false);
     }
 
-    inline PyVar call(const PyVar& obj, const Str& func){
+    inline PyVar call(const PyVar& obj, StrName func){
         return call(getattr(obj, func), pkpy::no_arg(), pkpy::no_arg(), false);
     }
 
@@ -131,7 +241,7 @@ public:
             if(new_f != nullptr){
                 obj = call(*new_f, args, kwargs, false);
             }else{
-                obj = new_object(_callable, DUMMY_VAL);
+                obj = new_instance(_callable);
                 PyVarOrNull init_f = getattr(obj, __init__, false);
                 if (init_f != nullptr) call(init_f, args, kwargs, false);
             }
@@ -147,8 +257,7 @@ public:
         
         if((*callable)->is_type(tp_native_function)){
             const auto& f = OBJ_GET(pkpy::NativeFunc, *callable);
-            if(kwargs.size() != 0) TypeError("native_function does not accept keyword arguments");
-            return f(this, args);
+            return f(this, args, kwargs);
         } else if((*callable)->is_type(tp_function)){
             const pkpy::Function& fn = PyFunction_AS_C(*callable);
             pkpy::shared_ptr<pkpy::NameDict> _locals = pkpy::make_shared<pkpy::NameDict>();
@@ -160,12 +269,12 @@ public:
                     locals.emplace(name, args[i++]);
                     continue;
                 }
-                TypeError("missing positional argument '" + name + "'");
+                TypeError("missing positional argument '" + name.str() + "'");
             }
 
             locals.insert(fn.kwargs.begin(), fn.kwargs.end());
 
-            std::vector<Str> positional_overrided_keys;
+            std::vector<StrName> positional_overrided_keys;
             if(!fn.starred_arg.empty()){
                 pkpy::List vargs;        // handle *args
                 while(i < args.size()) vargs.push_back(args[i++]);
@@ -183,21 +292,22 @@ public:
             }
             
             for(int i=0; i<kwargs.size(); i+=2){
-                const Str& key = PyStr_AS_C(kwargs[i]);
+                StrName key = PyStr_AS_C(kwargs[i]);
                 if(!fn.kwargs.contains(key)){
-                    TypeError(key.escape(true) + " is an invalid keyword argument for " + fn.name + "()");
+                    TypeError(key.str().escape(true) + " is an invalid keyword argument for " + fn.name.str() + "()");
                 }
                 const PyVar& val = kwargs[i+1];
                 if(!positional_overrided_keys.empty()){
                     auto it = std::find(positional_overrided_keys.begin(), positional_overrided_keys.end(), key);
                     if(it != positional_overrided_keys.end()){
-                        TypeError("multiple values for argument '" + key + "'");
+                        TypeError("multiple values for argument '" + key.str() + "'");
                     }
                 }
                 locals[key] = val;
             }
             PyVar _module = fn._module != nullptr ? fn._module : top_frame()->_module;
             auto _frame = _new_frame(fn.code, _module, _locals, fn._closure);
+            if(fn.code->is_coroutine) return _new_coroutine(std::move(_frame));
             if(fn.code->is_generator){
                 return PyIter(pkpy::make_shared<BaseIter, Generator>(
                     this, std::move(_frame)));
@@ -213,19 +323,149 @@ public:
 
     // repl mode is only for setting `frame->id` to 0
     PyVarOrNull exec(Str source, Str filename, CompileMode mode, PyVar _module=nullptr){
+        CodeObject_ code;
+        try {
+            code = compile(source, filename, mode);
+        }catch (const pkpy::Exception& e){
+            *_stderr << e.summary() << '\n';
+            flush_output();
+            return nullptr;
+        }
+        return exec(code, _module);
+    }
+
+    // run a compiled code object; it can be run any number of times.
+    // A run suspended by the budget returns nullptr and is continued by `resume()`
+    PyVarOrNull exec(const CodeObject_& code, PyVar _module=nullptr){
         if(_module == nullptr) _module = _main;
+        if(is_suspended()){         // a suspended run is abandoned
+            callstack = {};
+            _suspended_base = -1;
+        }
+        return _run_top_level([&](){ return _exec(code, _module, pkpy::make_shared<pkpy::NameDict>()); });
+    }
+
+    // continue a run suspended by the budget, with a fresh budget
+    PyVarOrNull resume(){
+        if(!is_suspended()) return nullptr;
+        i64 base_id = _suspended_base;
+        _suspended_base = -1;
+        return _run_top_level([&](){ return _exec_from(base_id); });
+    }
+
+    inline bool is_suspended() const { return _suspended_base >= 0; }
+
+    // thread-safe; raises KeyboardInterrupt within the next kCheckSlice preemption points of the current run.
+    // A flag set while no run is active is dropped when the next one starts.
+    inline void interrupt(){ _interrupted = true; }
+
+    template<typename F>
+    PyVarOrNull _run_top_level(F&& f){
+        PyVarOrNull ret = nullptr;
+        _suspendable = true;
         try {
-            CodeObject_ code = compile(source, filename, mode);
-            return _exec(code, _module, pkpy::make_shared<pkpy::NameDict>());
+            ret = f();
         }catch (const pkpy::Exception& e){
             *_stderr << e.summary() << '\n';
+            callstack = {};
         }
         catch (const std::exception& e) {
             *_stderr << "A std::exception occurred! It may be a bug, please report it!!\n";
             *_stderr << e.what() << '\n';
+            callstack = {};
         }
-        callstack = {};
-        return nullptr;
+        _suspendable = false;
+        if(ret == _py_op_preempt) ret = nullptr;
+        flush_output();
+        return ret;
+    }
+
+    void _reset_budget(){
+        _steps_left = budget_steps;
+        _deadline = -1;
+        if(budget_seconds >= 0){
+            _deadline = std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count() + budget_seconds;
+        }
+        _grace = false;
+        _next_slice();
+    }
+
+    inline void _next_slice(){
+        _slice = kCheckSlice;
+        if(_steps_left >= 0 && _steps_left < _slice) _slice = std::max<i64>(_steps_left, 1);
+        _ticks = _slice;
+    }
+
+    // slow path of a preemption point, run once per slice; return true to suspend the run
+    bool _checkpoint(){
+        if(_steps_left >= 0) _steps_left = std::max<i64>(_steps_left - _slice, 0);
+        _next_slice();
+        if(_stopping != nullptr) _stop_run(_stopping, _stopping_msg);
+        if(_interrupted.exchange(false)) _stop_run("KeyboardInterrupt", "interrupted by the host");
+        if(heap->limit >= 0){
+            heap->_recover();
+            if(heap->allocated > heap->_threshold) _memory_error();
+        }
+        bool exhausted = _steps_left == 0;
+        if(!exhausted && _deadline >= 0){
+            f64 now = std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            exhausted = now >= _deadline;
+        }
+        if(!exhausted) return false;
+        if(budget_suspends){
+            // frames under a native call cannot be suspended; give them one more budget to return
+            if(_suspendable && _exec_depth == 1) return true;
+            if(!_grace){
+                _reset_budget();
+                _grace = true;
+                return false;
+            }
+        }
+        _steps_left = -1;
+        _deadline = -1;
+        _next_slice();
+        _stop_run("TimeoutError", "execution budget exceeded");
+        return false;
+    }
+
+    // the first raise can be caught, leaving the handler a slice to clean up;
+    // if the run goes on past it, later raises skip every handler
+    void _stop_run(const char* type, const char* msg){
+        pkpy::Exception e(type, msg);
+        e.is_fatal = _stopping != nullptr;
+        _stopping = type;
+        _stopping_msg = msg;
+        _error(e);
+    }
+
+    // raise MemoryError before allocating `bytes` more would exceed the limit
+    inline void _reserve(i64 bytes){
+        if(heap->limit < 0) return;
+        heap->_recover();
+        if(heap->allocated + bytes > heap->_threshold) _memory_error();
+    }
+
+    // the handler gets 1/8 of the limit as headroom to clean up;
+    // another MemoryError before it has recovered skips every handler and ends the run
+    void _memory_error(){
+        pkpy::Exception e("MemoryError", "memory limit exceeded");
+        e.is_fatal = heap->_threshold > heap->limit;
+        heap->_threshold = heap->limit + heap->limit / 8;
+        _error(e);
+    }
+
+    // builtin singletons and types stop counting references; they are never freed
+    void _make_builtins_immortal(){
+        for(PyVar* obj : {&None, &True, &False, &Ellipsis, &_empty_str, &_py_op_call, &_py_op_yield, &_py_op_preempt}){
+            obj->make_immortal();
+        }
+        for(PyVar& obj : _ascii_str_pool) obj.make_immortal();
+        for(PyVar& obj : _all_types) obj.make_immortal();
+    }
+
+    inline void flush_output(){
+        _stdout->flush();
+        _stderr->flush();
     }
 
     template<typename ...Args>
@@ -242,9 +482,25 @@ public:
         return _exec();
     }
 
-    PyVar _exec(){
+    struct _ExecDepth {
+        VM* vm;
+        pkpy::_HeapScope heap_scope;
+        _ExecDepth(VM* vm) : vm(vm), heap_scope(vm->heap.get()) {
+            if(vm->_exec_depth++ > 0) return;
+            vm->_reset_budget();
+            vm->_stopping = nullptr;
+            vm->_interrupted = false;
+            if(vm->heap->allocated <= vm->heap->limit) vm->heap->_threshold = vm->heap->limit;     // a new run starts afresh
+        }
+        ~_ExecDepth(){ vm->_exec_depth--; }
+    };
+
+    inline PyVar _exec(){ return _exec_from(top_frame()->id); }
+
+    // run the callstack until the frame `base_id` returns
+    PyVar _exec_from(i64 base_id){
+        _ExecDepth _depth(this);
         Frame* frame = top_frame();
-        i64 base_id = frame->id;
         PyVar ret = nullptr;
         bool need_raise = false;
 
@@ -254,6 +510,10 @@ public:
                 if(need_raise){ need_raise = false; _raise(); }
                 ret = run_frame(frame);
                 if(ret == _py_op_yield) return _py_op_yield;
+                if(ret == _py_op_preempt){
+                    _suspended_base = base_id;
+                    return _py_op_preempt;
+                }
                 if(ret != _py_op_call){
                     if(frame->id == base_id){      // [ frameBase<- ]
                         callstack.pop();
@@ -304,6 +564,74 @@ public:
         return OBJ_GET(Type, obj);
     }
 
+    // the layout of a class with __slots__, by type index
+    std::vector<std::unique_ptr<pkpy::Shape>> _fixed_shapes;
+
+    pkpy::Shape* _fixed_shape(const PyVar& cls){
+        int i = OBJ_GET(Type, cls).index;
+        return i < (int)_fixed_shapes.size() ? _fixed_shapes[i].get() : nullptr;
+    }
+
+    // a class with __slots__ gets a fixed layout if its base has one, or is object;
+    // otherwise its instances can take any attribute, like those of its base
+    void _set_slots(PyVar cls, const PyVar& base, const pkpy::Tuple& names){
+        for(int j=0; j<names.size(); j++){
+            StrName key = PyStr_AS_C(names[j]);
+            if(cls->attr().contains(key)) ValueError(key.str().escape(true) + " in __slots__ conflicts with class variable");
+        }
+        setattr(cls, __slots__, PyTuple(names));
+        const pkpy::Shape* base_shape = _fixed_shape(base);
+        if(base_shape == nullptr && OBJ_GET(Type, base) != tp_object) return;
+        auto shape = std::make_unique<pkpy::Shape>();
+        if(base_shape != nullptr) shape->keys = base_shape->keys;
+        for(int j=0; j<names.size(); j++){
+            StrName key = PyStr_AS_C(names[j]);
+            if(shape->index_of(key) >= 0) TypeError("duplicate name " + key.str().escape(true) + " in __slots__");
+            shape->keys.push_back(key);
+        }
+        int i = OBJ_GET(Type, cls).index;
+        if(i >= (int)_fixed_shapes.size()) _fixed_shapes.resize(i + 1);
+        _fixed_shapes[i] = std::move(shape);
+    }
+
+    template<size_t... N>
+    PyVar _new_fixed_instance(const PyVar& cls, pkpy::Shape* shape, std::index_sequence<N...>){
+        using Maker = PyVar (*)(VM*, const PyVar&);
+        static const Maker makers[] = {
+            [](VM* vm, const PyVar& cls){ return vm->new_object(cls, pkpy::FixedInstance<N+1>()); }...
+        };
+        int size = shape->size();
+        if(size >= 1 && size <= (int)sizeof...(N)){
+            PyVar obj = makers[size-1](this, cls);
+            obj->_shape() = shape;
+            return obj;
+        }
+        PyVar obj = new_object(cls, pkpy::Instance());
+        obj->_flags |= PyObject::kFixed;
+        if(size > 0) obj->_instance().values = new PyVar[size];
+        obj->_shape() = shape;
+        obj->_account();
+        return obj;
+    }
+
+    pkpy::Shape* _root_shape(const PyVar& cls){
+        int i = OBJ_GET(Type, cls).index;
+        if(i >= (int)_root_shapes.size()) _root_shapes.resize(i + 1);
+        if(_root_shapes[i] == nullptr) _root_shapes[i] = std::make_unique<pkpy::Shape>();
+        return _root_shapes[i].get();
+    }
+
+    // an instance of a python class, before __init__
+    PyVar new_instance(const PyVar& cls){
+        pkpy::Shape* shape = _fixed_shape(cls);
+        if(shape == nullptr){
+            PyVar obj = new_object(cls, pkpy::Instance());
+            obj->_shape() = _root_shape(cls);
+            return obj;
+        }
+        return _new_fixed_instance(cls, shape, std::make_index_sequence<pkpy::kMaxInlineSlots>());
+    }
+
     template<typename T>
     inline PyVar new_object(const PyVar& type, const T& _value) {
         if(!type->is_type(tp_type)) UNREACHABLE();
@@ -336,7 +664,22 @@ public:
         return obj;
     }
 
-    PyVarOrNull getattr(const PyVar& obj, const Str& name, bool throw_err=true) {
+    // a loaded module, or a lazy one compiled and run on first use
+    PyVar import_module(StrName name){
+        auto it = _modules.find(name);
+        if(it != _modules.end()) return it->second;
+        auto it2 = _lazy_modules.find(name.str());
+        if(it2 == _lazy_modules.end()){
+            _error("ImportError", "module " + name.str().escape(true) + " not found");
+        }
+        CodeObject_ code = compile(it2->second, name.str(), EXEC_MODE);
+        PyVar _m = new_module(name.str());
+        _exec(code, _m, pkpy::make_shared<pkpy::NameDict>());
+        _lazy_modules.erase(it2);
+        return _m;
+    }
+
+    PyVarOrNull getattr(const PyVar& obj, StrName name, bool throw_err=true) {
         pkpy::NameDict::iterator it;
         PyObject* cls;
 
@@ -351,12 +694,14 @@ public:
             cls = _t(*root).get();
             for(int i=0; i<depth; i++) cls = cls->attr(__base__).get();
 
-            it = (*root)->attr().find(name);
-            if(it != (*root)->attr().end()) return it->second;        
+            if((*root)->is_attr_valid()){
+                PyVar* val = (*root)->attr_try_get(name);
+                if(val != nullptr) return *val;
+            }
         }else{
             if(obj->is_attr_valid()){
-                it = obj->attr().find(name);
-                if(it != obj->attr().end()) return it->second;
+                PyVar* val = obj->attr_try_get(name);
+                if(val != nullptr) return *val;
             }
             cls = _t(obj).get();
         }
@@ -378,11 +723,20 @@ public:
     }
 
     template<typename T>
-    inline void setattr(PyVar& obj, const Str& name, T&& value) {
+    inline void setattr(PyVar& obj, StrName name, T&& value) {
         PyObject* p = obj.get();
         while(p->is_type(tp_super)) p = static_cast<PyVar*>(p->value())->get();
         if(!p->is_attr_valid()) TypeError("cannot set attribute");
+        if(p->_is_shaped()){
+            PyVar* slot = p->_shape_slot(name);
+            if(slot != nullptr){
+                *slot = std::forward<T>(value);
+                return;
+            }
+            if(p->_is_fixed()) AttributeError(obj, name);
+        }
         p->attr()[name] = std::forward<T>(value);
+        p->_account();
     }
 
     template<int ARGC>
@@ -396,6 +750,14 @@ public:
         setattr(obj, funcName, PyNativeFunc(pkpy::NativeFunc(fn, ARGC, false)));
     }
 
+    // `kwargs` are the keyword arguments and their defaults, appended to `args` in order
+    template<int ARGC>
+    void bind_func(PyVar obj, Str funcName, std::vector<std::pair<StrName, PyVar>> kwargs, NativeFuncRaw fn) {
+        pkpy::NativeFunc f(fn, ARGC, false);
+        f.kwargs = std::move(kwargs);
+        setattr(obj, funcName, PyNativeFunc(std::move(f)));
+    }
+
     template<int ARGC>
     void bind_func(Str typeName, Str funcName, NativeFuncRaw fn) {
         bind_func<ARGC>(_types[typeName], funcName, fn);     
@@ -421,6 +783,11 @@ public:
         bind_func<ARGC>(builtins, funcName, fn);
     }
 
+    template<int ARGC>
+    void bind_builtin_func(Str funcName, std::vector<std::pair<StrName, PyVar>> kwargs, NativeFuncRaw fn) {
+        bind_func<ARGC>(builtins, funcName, std::move(kwargs), fn);
+    }
+
     inline f64 num_to_float(const PyVar& obj){
         if (obj->is_type(tp_int)){
             return (f64)PyInt_AS_C(obj);
@@ -484,12 +851,12 @@ public:
                 argStr += " (" + PyStr_AS_C(asRepr(co->consts[byte.arg])) + ")";
             }
             if(byte.op == OP_LOAD_NAME_REF || byte.op == OP_LOAD_NAME || byte.op == OP_RAISE){
-                argStr += " (" + co->names[byte.arg].first.escape(true) + ")";
+                argStr += " (" + co->names[byte.arg].first.str().escape(true) + ")";
             }
             if(byte.op == OP_FAST_INDEX || byte.op == OP_FAST_INDEX_REF){
                 auto& a = co->names[byte.arg & 0xFFFF];
                 auto& x = co->names[(byte.arg >> 16) & 0xFFFF];
-                argStr += " (" + a.first + '[' + x.first + "])";
+                argStr += " (" + a.first.str() + '[' + x.first.str() + "])";
             }
             ss << pad(argStr, 20);      // may overflow
             ss << co->blocks[byte.block].to_string();
@@ -503,7 +870,7 @@ public:
         names << "co_names: ";
         pkpy::List list;
         for(int i=0; i<co->names.size(); i++){
-            list.push_back(PyStr(co->names[i].first));
+            list.push_back(PyStr(co->names[i].first.str()));
         }
         names << PyStr_AS_C(asRepr(PyList(list)));
         ss << '\n' << consts.str() << '\n' << names.str() << '\n';
@@ -522,7 +889,7 @@ public:
     Type tp_object, tp_type, tp_int, tp_float, tp_bool, tp_str;
     Type tp_list, tp_tuple;
     Type tp_function, tp_native_function, tp_native_iterator, tp_bound_method;
-    Type tp_slice, tp_range, tp_module, tp_ref;
+    Type tp_slice, tp_range, tp_module, tp_ref, tp_bytes, tp_bytearray;
     Type tp_super, tp_exception;
 
     template<typename P>
@@ -541,14 +908,23 @@ public:
         check_type(obj, tp_str);
         return OBJ_GET(Str, obj);
     }
+    inline PyVarOrNull _cached_str(const Str& value) {
+        if(value.size() > 1) return nullptr;
+        if(value.empty()) return _empty_str;
+        unsigned char c = value[0];
+        if(c < 128) return _ascii_str_pool[c];
+        return nullptr;
+    }
     inline PyVar PyStr(const Str& value) {
-        // some BUGs here
-        // if(value.size() == 1){
-        //     char c = value.c_str()[0];
-        //     if(c >= 0) return _ascii_str_pool[(int)c];
-        // }
+        PyVarOrNull cached = _cached_str(value);
+        if(cached != nullptr) return cached;
         return new_object(tp_str, value);
     }
+    inline PyVar PyStr(Str&& value) {
+        PyVarOrNull cached = _cached_str(value);
+        if(cached != nullptr) return cached;
+        return new_object(tp_str, std::move(value));
+    }
 
     DEF_NATIVE(Int, i64, tp_int)
     DEF_NATIVE(Float, f64, tp_float)
@@ -559,6 +935,8 @@ public:
     DEF_NATIVE(Iter, pkpy::shared_ptr<BaseIter>, tp_native_iterator)
     DEF_NATIVE(BoundMethod, pkpy::BoundMethod, tp_bound_method)
     DEF_NATIVE(Range, pkpy::Range, tp_range)
+    DEF_NATIVE(Bytes, pkpy::Bytes, tp_bytes)
+    DEF_NATIVE(ByteArray, pkpy::Bytes, tp_bytearray)
     DEF_NATIVE(Slice, pkpy::Slice, tp_slice)
     DEF_NATIVE(Exception, pkpy::Exception, tp_exception)
     
@@ -586,6 +964,7 @@ public:
         tp_range = _new_type_object("range");
         tp_module = _new_type_object("module");
         tp_ref = _new_type_object("_ref");
+        tp_bytes = _new_type_object("bytes");
         
         tp_function = _new_type_object("function");
         tp_native_function = _new_type_object("native_function");
@@ -593,24 +972,29 @@ public:
         tp_bound_method = _new_type_object("bound_method");
         tp_super = _new_type_object("super");
         tp_exception = _new_type_object("Exception");
+        tp_bytearray = _new_type_object("bytearray");
 
         this->None = new_object(_new_type_object("NoneType"), DUMMY_VAL);
         this->Ellipsis = new_object(_new_type_object("ellipsis"), DUMMY_VAL);
         this->True = new_object(tp_bool, true);
         this->False = new_object(tp_bool, false);
+        // must be ready before the first PyStr() call
+        this->_empty_str = new_object(tp_str, Str());
+        for(int i=0; i<128; i++) _ascii_str_pool[i] = new_object(tp_str, Str(std::string(1, (char)i)));
         this->builtins = new_module("builtins");
         this->_main = new_module("__main__");
         this->_py_op_call = new_object(_new_type_object("_py_op_call"), DUMMY_VAL);
         this->_py_op_yield = new_object(_new_type_object("_py_op_yield"), DUMMY_VAL);
+        this->_py_op_preempt = new_object(_new_type_object("_py_op_preempt"), DUMMY_VAL);
 
         setattr(_t(tp_type), __base__, _t(tp_object));
         setattr(_t(tp_object), __base__, None);
         
         for (auto& [name, type] : _types) {
-            setattr(type, __name__, PyStr(name));
+            setattr(type, __name__, PyStr(name.str()));
         }
 
-        std::vector<Str> pb_types = {"type", "object", "bool", "int", "float", "str", "list", "tuple", "range"};
+        std::vector<Str> pb_types = {"type", "object", "bool", "int", "float", "str", "list", "tuple", "range", "bytes", "bytearray"};
         for (auto& name : pb_types) {
             setattr(builtins, name, _types[name]);
         }
@@ -624,6 +1008,7 @@ public:
             return (i64)std::hash<f64>()(val);
         }
         if (obj->is_type(tp_str)) return PyStr_AS_C(obj).hash();
+        if (obj->is_type(tp_bytes)) return (i64)std::hash<std::string>()(PyBytes_AS_C(obj));
         if (obj->is_type(tp_type)) return (i64)obj.get();
         if (obj->is_type(tp_tuple)) {
             i64 x = 1000003;
@@ -639,11 +1024,12 @@ public:
     }
 
     /***** Error Reporter *****/
-private:
+    // raise an error of any type by name, e.g. one reported by another vm
     void _error(const Str& name, const Str& msg){
         _error(pkpy::Exception(name, msg));
     }
 
+    // raise a caught exception again, e.g. one stored by a future
     void _error(pkpy::Exception e){
         if(callstack.empty()){
             e.is_re = false;
@@ -653,8 +1039,9 @@ private:
         _raise();
     }
 
+private:
     void _raise(){
-        bool ok = top_frame()->jump_to_exception_handler();
+        bool ok = !PyException_AS_C(top_frame()->top()).is_fatal && top_frame()->jump_to_exception_handler();
         if(ok) throw HandledException();
         else throw UnhandledException();
     }
@@ -666,10 +1053,11 @@ public:
     void ZeroDivisionError(){ _error("ZeroDivisionError", "division by zero"); }
     void IndexError(const Str& msg){ _error("IndexError", msg); }
     void ValueError(const Str& msg){ _error("ValueError", msg); }
-    void NameError(const Str& name){ _error("NameError", "name " + name.escape(true) + " is not defined"); }
+    void RuntimeError(const Str& msg){ _error("RuntimeError", msg); }
+    void NameError(StrName name){ _error("NameError", "name " + name.str().escape(true) + " is not defined"); }
 
-    void AttributeError(PyVar obj, const Str& name){
-        _error("AttributeError", "type " +  OBJ_NAME(_t(obj)).escape(true) + " has no attribute " + name.escape(true));
+    void AttributeError(PyVar obj, StrName name){
+        _error("AttributeError", "type " +  OBJ_NAME(_t(obj)).escape(true) + " has no attribute " + name.str().escape(true));
     }
 
     inline void check_type(const PyVar& obj, Type type){
@@ -700,13 +1088,28 @@ public:
     }
 
     ~VM() {
-        if(!use_stdio){
-            delete _stdout;
-            delete _stderr;
-        }
+        // the objects freed with the members are credited to this heap
+        _heap_restore.prev = pkpy::_heap;
+        pkpy::_heap = heap.get();
+        heap->_ticks = nullptr;
+        delete _stdout;
+        delete _stderr;
     }
 
     CodeObject_ compile(Str source, Str filename, CompileMode mode);
+    PyVar _new_coroutine(std::unique_ptr<Frame>&& frame);
+
+    CodeObject_ compile_cached(const Str& source, CompileMode mode){
+        bool is_eval = mode == EVAL_MODE;
+        auto& cache = is_eval ? _eval_cache : _exec_cache;
+        CodeObject_* code = cache.get(source);
+        if(code != nullptr){
+            _code_cache_hits++;
+            return *code;
+        }
+        _code_cache_misses++;
+        return cache.put(source, compile(source, is_eval ? "<eval>" : "<exec>", mode));
+    }
 };
 
 /***** Pointers' Impl *****/
@@ -740,6 +1143,12 @@ void NameRef::set(VM* vm, Frame* frame, PyVar val) const{
     }
 }
 
+PyVar* NameRef::slot(VM* vm, Frame* frame) const{
+    PyVar* val = frame->f_locals().try_get(name());
+    if(val != nullptr || scope() != NAME_GLOBAL) return val;
+    return frame->f_globals().try_get(name());
+}
+
 void NameRef::del(VM* vm, Frame* frame) const{
     switch(scope()) {
         case NAME_LOCAL: {
@@ -775,8 +1184,13 @@ void AttrRef::set(VM* vm, Frame* frame, PyVar val) const{
 
 void AttrRef::del(VM* vm, Frame* frame) const{
     if(!obj->is_attr_valid()) vm->TypeError("cannot delete attribute");
-    if(!obj->attr().contains(attr.name())) vm->AttributeError(obj, attr.name());
-    obj->attr().erase(attr.name());
+    PyVar* val = obj->attr_try_get(attr.name());
+    if(val == nullptr) vm->AttributeError(obj, attr.name());
+    if(obj->_is_fixed()){
+        *val = nullptr;     // the slot is unset
+    }else{
+        obj->attr().erase(attr.name());     // an instance keeps a dict from now on
+    }
 }
 
 PyVar IndexRef::get(VM* vm, Frame* frame) const{
@@ -826,20 +1240,36 @@ inline void Frame::try_deref(VM* vm, PyVar& v){
     if(v->is_type(vm->tp_ref)) v = vm->PyRef_AS_C(v)->get(vm, this);
 }
 
-PyVar pkpy::NativeFunc::operator()(VM* vm, pkpy::Args& args) const{
+PyVar pkpy::NativeFunc::operator()(VM* vm, pkpy::Args& args, const pkpy::Args& kwargs) const{
     int args_size = args.size() - (int)method;  // remove self
     if(argc != -1 && args_size != argc) {
         vm->TypeError("expected " + std::to_string(argc) + " arguments, but got " + std::to_string(args_size));
     }
-    return f(vm, args);
+    if(this->kwargs.empty()){
+        if(kwargs.size() != 0) vm->TypeError("native_function does not accept keyword arguments");
+        return f(vm, args);
+    }
+    int n = args.size();
+    pkpy::Args full(n + (int)this->kwargs.size());
+    for(int i=0; i<n; i++) full[i] = args[i];
+    for(int i=0; i<this->kwargs.size(); i++) full[n+i] = this->kwargs[i].second;
+    for(int i=0; i<kwargs.size(); i+=2){
+        StrName key = vm->PyStr_AS_C(kwargs[i]);
+        int j = 0;
+        while(j < this->kwargs.size() && this->kwargs[j].first != key) j++;
+        if(j == this->kwargs.size()) vm->TypeError(key.str().escape(true) + " is an invalid keyword argument");
+        full[n+j] = kwargs[i+1];
+    }
+    return f(vm, full);
 }
 
 void CodeObject::optimize(VM* vm){
     for(int i=1; i<codes.size(); i++){
         if(codes[i].op == OP_UNARY_NEGATIVE && codes[i-1].op == OP_LOAD_CONST){
             codes[i].op = OP_NO_OP;
+            // consts are shared between load sites, so append the negated value
             int pos = codes[i-1].arg;
-            consts[pos] = vm->num_negated(consts[pos]);
+            codes[i-1].arg = add_const(vm->num_negated(consts[pos]));
         }
 
         if(i>=2 && codes[i].op == OP_BUILD_INDEX){
@@ -0,0 +1,111 @@
+import asyncio
+
+async def add(a, b):
+    return a + b
+
+async def worker(name, n, log):
+    for i in range(n):
+        log.append((name, i))
+        await asyncio.sleep(0)
+    return name
+
+async def boom():
+    await asyncio.sleep(0)
+    raise ValueError("bad")
+
+async def main():
+    assert await add(1, 2) == 3
+    assert await add(1, 2) + await add(3, 4) * 2 == 17
+
+    # tasks interleave at every await
+    log = []
+    t1 = asyncio.create_task(worker('a', 3, log))
+    t2 = asyncio.create_task(worker('b', 3, log))
+    assert await asyncio.gather(t1, t2, add(10, 20)) == ['a', 'b', 30]
+    assert log == [('a', 0), ('b', 0), ('a', 1), ('b', 1), ('a', 2), ('b', 2)]
+    assert t1.done() and t1.result() == 'a'
+
+    try:
+        await boom()
+        exit(1)
+    except ValueError:
+        pass
+
+    f = asyncio.Future()
+    assert not f.done()
+    async def setter():
+        await asyncio.sleep(0.01)
+        f.set_result(42)
+    asyncio.create_task(setter())
+    assert await f == 42
+    assert f.result() == 42
+
+    tasks = [asyncio.create_task(add(i, i)) for i in range(2000)]
+    s = 0
+    for t in tasks:
+        s += await t
+    assert s == 2000 * 1999
+
+    try:
+        await 5
+        exit(1)
+    except TypeError:
+        pass
+    return 'done'
+
+assert asyncio.run(main()) == 'done'
+
+try:
+    asyncio.run(boom())
+    exit(1)
+except ValueError:
+    pass
+
+class C:
+    async def m(self, x):
+        def twice(y):
+            return y * 2
+        return twice(x)
+
+assert asyncio.run(C().m(4)) == 8
+assert type(add(1, 2)) is coroutine
+
+# host futures completed from other threads overlap instead of blocking the vm
+import time
+async def host_calls():
+    t0 = time.time()
+    futures = [asyncio.host_timer(0.2, i) for i in range(50)]
+    s = 0
+    for f in futures:
+        s += await f
+    assert s == 1225
+    assert time.time() - t0 < 2.0
+    async def job(i):
+        return await asyncio.host_timer(0.01 * i, [i, 'x'])
+    assert await asyncio.gather(job(2), job(1), job(0)) == [[2, 'x'], [1, 'x'], [0, 'x']]
+asyncio.run(host_calls())
+
+# a host future nobody awaits is dropped, so a stuck main task is reported instead of waiting on it
+async def stuck():
+    asyncio.host_timer(3600, 0)
+    await asyncio.Future()
+try:
+    asyncio.run(stuck())
+    exit(1)
+except RuntimeError:
+    pass
+
+# and so is one that only a task dropped by asyncio.run() was awaiting
+async def leave_behind():
+    async def waiter():
+        await asyncio.host_timer(3600, 0)
+    asyncio.create_task(waiter())
+    await asyncio.sleep(0)
+asyncio.run(leave_behind())
+async def wait_forever():
+    await asyncio.Future()
+try:
+    asyncio.run(wait_forever())
+    exit(1)
+except RuntimeError:
+    pass
@@ -3,6 +3,16 @@
 assert 0xffff == 65535
 assert 0xAAFFFF == 11206655
 assert 0x7fffffff == 2147483647
+assert 0b1011 == 11 and 0o17 == 15 and 0B11 == 3
+assert 1_000_000 == 1000000 and 0xff_ff == 65535
+assert .5 == 0.5 and 1. == 1.0 and 2.5e3 == 2500.0
+assert 1e-3 == 0.001 and 1E+2 == 100.0 and 1_0.0_1 == 10.01
+assert 9223372036854775807 == 0x7fffffffffffffff
+
+# constants are shared, negating one load site must not affect the others
+def f():
+    return [1, -1, 1, 2.5, -2.5, 2.5, 'a', 'a']
+assert f() == [1, -1, 1, 2.5, -2.5, 2.5, 'a', 'a']
 
 # test == != >= <= < > 
 # generate 2 cases for each operator
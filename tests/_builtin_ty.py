@@ -67,6 +67,34 @@ assert '|'.join(f()) == '0|1|2|3|4'
 num = 6
 assert str(num) == '6'
 
+# in-place append must not leak into other references
+s1 = 'ab'
+s2 = s1
+s1 += 'cd'
+assert s1 == 'abcd' and s2 == 'ab'
+d = {s1: 1}
+s1 += 'e'
+assert s1 == 'abcde' and len(s1) == 5
+assert d['abcd'] == 1
+
+def build(n):
+    s = ''
+    for i in range(n):
+        s += str(i % 10)
+    return s
+s = build(100000)
+assert len(s) == 100000 and s[99999] == '9'
+assert f'{num}-{s1}-{1.5}' == '6-abcde-1.5'
+
+# single ascii chars and '' are shared objects
+assert 'abc'[1] is 'b' and chr(98) is 'b'
+assert [c for c in 'ab'][0] is 'a'
+assert 'abc'[1:1] is ''
+assert ord(chr(127)) == 127
+c = 'x'
+c += 'y'
+assert c == 'xy' and 'x' == 'x'[0]
+
 ##############################################
 ##Lists
 ##############################################
@@ -204,4 +232,48 @@ assert not all([True, False])
 assert not all([False, False])
 
 assert list(enumerate([1,2,3])) == [(0,1), (1,2), (2,3)]
-assert list(enumerate([1,2,3], 1)) == [(1,1), (2,2), (3,3)]
\ No newline at end of file
+assert list(enumerate([1,2,3], 1)) == [(1,1), (2,2), (3,3)]
+##############################################
+##Floats
+##############################################
+
+assert repr(0.1) == '0.1' and repr(100.0) == '100.0' and str(-0.0) == '-0.0'
+assert repr(1e16) == '1e+16' and repr(1e15) == '1000000000000000.0'
+assert repr(0.0001) == '0.0001' and repr(1e-5) == '1e-05'
+assert repr(1/3) == '0.3333333333333333'
+assert float(' 1.5 ') == 1.5 and float('+2') == 2.0 and float('-inf') < 0
+assert int(' 42 ') == 42 and int('+3') == 3 and int('-7') == -7
+try:
+    int('4 2')
+    exit(1)
+except ValueError:
+    pass
+
+##############################################
+##Bytes
+##############################################
+
+b = 'a\n测'.encode()
+assert len(b) == 5 and b[0] == 97
+assert repr(b) == "b'a\\n\\xe6\\xb5\\x8b'"
+assert b.decode() == 'a\n测'
+assert bytes([104, 105]) == 'hi'.encode() and b != 'a'
+
+# bytes are hashable, bytearray is mutable
+d = {'ab'.encode(): 1, bytes([1, 2]): 2}
+assert d['ab'.encode()] == 1 and d[bytes([1, 2])] == 2
+assert hash(bytes([120, 121])) == hash('xy'.encode())
+a = bytearray('abc'.encode())
+a[0] = 65
+assert a == 'Abc'.encode() and bytes(a) == 'Abc'.encode() and a.decode() == 'Abc'
+assert a[1:] == bytearray('bc'.encode()) and len(a) == 3
+assert repr(a) == "bytearray(b'Abc')"
+assert 'Abc'.encode() == a and a == 'Abc'.encode()
+assert not ('Abd'.encode() == a) and 'Abd'.encode() != a and not ('Abc'.encode() != a)
+
+assert 'aXbXc'.replace('X', '--') == 'a--b--c'
+assert 'abc'.replace('', '-') == '-a-b-c-'
+assert ''.replace('', 'x') == 'x'
+assert 'aaa'.replace('aa', 'b') == 'ba'
+assert 'héé'.replace('', '|') == '|h|é|é|'
+assert 'abc'.replace('z', 'y') == 'abc'
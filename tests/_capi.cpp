@@ -0,0 +1,574 @@
+// tests of the C API, built against pocketpy.h by scripts/run_tests.py
+#include "pocketpy.h"
+
+#include <thread>
+
+#define CHECK(expr) do {                                                        \
+    if(!(expr)){                                                                \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+        exit(1);                                                                \
+    }                                                                           \
+} while(0)
+
+// run a source in a fresh module; false if it raised
+static bool run(VM* vm, const char* source){
+    CodeObject_* code = pkpy_compile(vm, source, "main.py", 0);
+    if(code == nullptr) return false;
+    PkHandle* ret = pkpy_run(vm, code, nullptr);
+    pkpy_delete(code);
+    pkpy_release(ret);
+    return ret != nullptr;
+}
+
+// the stdout and stderr collected since the last read, as json
+static std::string read_output(VM* vm){
+    char* out = pkpy_vm_read_output(vm);
+    std::string s = out != nullptr ? out : "";
+    pkpy_delete(out);
+    return s;
+}
+
+// the repr of an expression evaluated in __main__
+static std::string eval(VM* vm, const char* source){
+    char* ret = pkpy_vm_eval(vm, source);
+    std::string s = ret != nullptr ? ret : "<error>";
+    pkpy_delete(ret);
+    return s;
+}
+
+/************ exported pointers ************/
+static void test_export_table(){
+    VM* vm = pkpy_new_vm(false);
+    char* stats = pkpy_export_stats();
+    CHECK(strstr(stats, "\"live\": {\"VM\": 1}") != nullptr);
+    CHECK(strstr(stats, "\"invalid\": 0") != nullptr);
+    CHECK(pkpy_delete(stats));
+    CHECK(!pkpy_delete(stats));
+
+    int unknown;
+    CHECK(!pkpy_delete(&unknown));
+    CHECK(pkpy_delete(vm));
+    CHECK(!pkpy_delete(vm));
+    stats = pkpy_export_stats();
+    CHECK(strstr(stats, "\"live\": {}") != nullptr);
+    CHECK(strstr(stats, "\"invalid\": 3") != nullptr);
+    pkpy_delete(stats);
+}
+
+/************ host functions ************/
+static PkHandle* identity(VM* vm, PkHandle** argv, int argc, void* userdata){
+    return argv[0];
+}
+
+static PkHandle* sum_ints(VM* vm, PkHandle** argv, int argc, void* userdata){
+    i64 total = 0;
+    for(int i=0; i<argc; i++){
+        i64 x;
+        if(!pkpy_to_int(vm, argv[i], &x)){
+            pkpy_set_error(vm, "expected int");
+            return nullptr;
+        }
+        total += x;
+    }
+    return pkpy_new_int(vm, total);
+}
+
+static PkHandle* keep(VM* vm, PkHandle** argv, int argc, void* userdata){
+    *(PkHandle**)userdata = pkpy_retain(argv[0]);
+    return nullptr;
+}
+
+// call argv[0]; on error return -1, or None if asked to, or let the error through
+static PkHandle* call_or_default(VM* vm, PkHandle** argv, int argc, void* userdata){
+    PkHandle* ret = pkpy_call(vm, argv[0], nullptr, 0);
+    if(ret != nullptr) return ret;
+    const char* mode; int size;
+    CHECK(pkpy_to_str_view(vm, argv[1], &mode, &size));
+    std::string m(mode, size);
+    if(m == "raise") return nullptr;
+    pkpy_clear_error(vm);
+    return m == "none" ? nullptr : pkpy_new_int(vm, -1);
+}
+
+static void test_bind_native(){
+    VM* vm = pkpy_new_vm(false);
+    PkHandle* kept = nullptr;
+    pkpy_vm_bind_native(vm, "host", "identity", 1, identity, nullptr);
+    pkpy_vm_bind_native(vm, "host", "sum", -1, sum_ints, nullptr);
+    pkpy_vm_bind_native(vm, "host", "keep", 1, keep, &kept);
+
+    // returning an argument hands it back to the vm
+    CHECK(run(vm, "import host\nx = [1, 2]\nassert host.identity(x) is x\nassert host.identity('a' * 3) == 'aaa'"));
+    CHECK(run(vm, "import host\nassert host.sum(1, 2, 3) == 6"));
+    CHECK(run(vm, "import host\nassert host.sum(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12) == 78"));
+    CHECK(!run(vm, "import host\nhost.sum(1, 'x')"));
+    CHECK(!run(vm, "import host\nhost.identity(1, 2)"));
+
+    // an error of a C API call is raised only if the host function does not handle it
+    pkpy_vm_bind_native(vm, "host", "call_or_default", 2, call_or_default, nullptr);
+    CHECK(run(vm,
+        "import host\n"
+        "for i in range(100):\n"
+        "  assert host.call_or_default((lambda: 1 // 0), 'value') == -1\n"
+        "  assert host.call_or_default((lambda: 1 // 0), 'none') is None\n"
+        "  assert host.call_or_default((lambda: 7), 'raise') == 7\n"
+        "  try:\n"
+        "    host.call_or_default((lambda: 1 // 0), 'raise')\n"
+        "    exit(1)\n"
+        "  except ZeroDivisionError:\n"
+        "    pass\n"
+        "  assert host.call_or_default((lambda: host.call_or_default((lambda: [][1]), 'raise')), 'value') == -1\n"
+        "  try:\n"
+        "    host.call_or_default((lambda: host.call_or_default((lambda: [][1]), 'value') + []), 'raise')\n"
+        "    exit(1)\n"
+        "  except TypeError:\n"
+        "    pass"));
+
+    // a retained argument outlives the call
+    CHECK(run(vm, "import host\nhost.keep('kept' + str(1))"));
+    const char* s; int size;
+    CHECK(kept != nullptr && pkpy_to_str_view(vm, kept, &s, &size) && std::string(s, size) == "kept1");
+    pkpy_release(kept);
+
+    pkpy_delete(vm);
+}
+
+/************ handles ************/
+static void test_handles(){
+    VM* vm = pkpy_new_vm(false);
+    PkHandle* a = pkpy_new_int(vm, 40);
+    PkHandle* b = pkpy_new_float(vm, 2.5);
+    PkHandle* t = pkpy_new_bool(vm, true);
+    PkHandle* s = pkpy_new_str(vm, "abc", 2);
+    PkHandle* n = pkpy_new_none(vm);
+    i64 x; f64 f; bool flag; const char* view; int size; void* p;
+    CHECK(pkpy_to_int(vm, a, &x) && x == 40);
+    CHECK(!pkpy_to_int(vm, b, &x));
+    CHECK(pkpy_to_float(vm, a, &f) && f == 40.0);
+    CHECK(pkpy_to_float(vm, b, &f) && f == 2.5);
+    CHECK(!pkpy_to_float(vm, s, &f));
+    CHECK(pkpy_to_bool(vm, t, &flag) && flag);
+    CHECK(!pkpy_to_bool(vm, a, &flag));
+    CHECK(pkpy_to_str_view(vm, s, &view, &size) && std::string(view, size) == "ab");
+    CHECK(!pkpy_to_str_view(vm, n, &view, &size));
+    PkHandle* vp = pkpy_new_voidp(vm, &x);
+    CHECK(pkpy_to_voidp(vm, vp, &p) && p == &x);
+    CHECK(!pkpy_to_voidp(vm, a, &p));
+
+    // a retained handle stays valid until each reference is released
+    CHECK(pkpy_retain(a) == a);
+    pkpy_release(a);
+    CHECK(pkpy_to_int(vm, a, &x) && x == 40);
+
+    PkHandle* items[] = {a, s, n};
+    PkHandle* list = pkpy_new_list(vm, items, 3);
+    CHECK(pkpy_len(vm, list) == 3);
+    CHECK(pkpy_len(vm, a) == -1);
+    PkHandle* append = pkpy_getattr(vm, list, "append");
+    PkHandle* r = pkpy_call(vm, append, &b, 1);
+    CHECK(r != nullptr && pkpy_len(vm, list) == 4);
+    CHECK(pkpy_getattr(vm, list, "missing") == nullptr);
+    CHECK(pkpy_call(vm, a, nullptr, 0) == nullptr);
+
+    pkpy_set_global(vm, "xs", list);
+    CHECK(eval(vm, "xs") == "[40, 'ab', None, 2.5]");
+    PkHandle* g = pkpy_get_global(vm, "xs");
+    CHECK(g != nullptr && pkpy_len(vm, g) == 4);
+    CHECK(pkpy_get_global(vm, "missing") == nullptr);
+
+    PkHandle* d = pkpy_new_dict(vm);
+    CHECK(pkpy_setitem(vm, d, s, a));
+    PkHandle* v = pkpy_getitem(vm, d, s);
+    CHECK(v != nullptr && pkpy_to_int(vm, v, &x) && x == 40);
+    CHECK(pkpy_getitem(vm, d, a) == nullptr);
+    CHECK(!pkpy_setitem(vm, a, s, a));
+    CHECK(read_output(vm).find("KeyError") != std::string::npos);
+
+    for(PkHandle* h : {a, b, t, s, n, vp, list, append, r, g, d, v}) pkpy_release(h);
+    pkpy_delete(vm);
+}
+
+/************ compiled code ************/
+static void test_compile(){
+    VM* vm = pkpy_new_vm(false);
+    CHECK(pkpy_compile(vm, "1 +", "main.py", 1) == nullptr);
+    CHECK(read_output(vm).find("SyntaxError") != std::string::npos);
+    CHECK(pkpy_compile(vm, "1", "main.py", 2) == nullptr);
+
+    // a code object runs any number of times, in the module given
+    PkHandle* mod = pkpy_new_module(vm, "m");
+    PkHandle* zero = pkpy_new_int(vm, 0);
+    CHECK(pkpy_setattr(vm, mod, "k", zero));
+    CodeObject_* incr = pkpy_compile(vm, "k += 1", "main.py", 0);
+    CodeObject_* twice = pkpy_compile(vm, "k * 2", "<eval>", 1);
+    CHECK(incr != nullptr && twice != nullptr);
+    for(int i=0; i<3; i++){
+        PkHandle* ret = pkpy_run(vm, incr, mod);
+        CHECK(ret != nullptr);
+        pkpy_release(ret);
+    }
+    PkHandle* ret = pkpy_run(vm, twice, mod);
+    i64 x;
+    CHECK(ret != nullptr && pkpy_to_int(vm, ret, &x) && x == 6);
+    pkpy_release(ret);
+
+    // without a module, each run starts from fresh globals
+    CHECK(pkpy_run(vm, incr, nullptr) == nullptr);
+    CHECK(read_output(vm).find("NameError") != std::string::npos);
+    CHECK(pkpy_run(vm, incr, zero) == nullptr);
+
+    pkpy_delete(incr);
+    pkpy_delete(twice);
+    pkpy_release(mod);
+    pkpy_release(zero);
+    pkpy_delete(vm);
+}
+
+/************ output ************/
+struct Captured {
+    std::string out, err;
+};
+
+static void capture_out(const char* data, size_t size, void* userdata){
+    ((Captured*)userdata)->out.append(data, size);
+}
+
+static void capture_err(const char* data, size_t size, void* userdata){
+    ((Captured*)userdata)->err.append(data, size);
+}
+
+static PkHandle* seen(VM* vm, PkHandle** argv, int argc, void* userdata){
+    pkpy_vm_flush_output(vm);
+    const std::string& out = ((Captured*)userdata)->out;
+    return pkpy_new_str(vm, out.c_str(), (int)out.size());
+}
+
+static void test_output(){
+    VM* vm = pkpy_new_vm(false);
+    pkpy_vm_exec(vm, "print('hi')\nraise ValueError('no')");
+    std::string out = read_output(vm);
+    CHECK(out.find("\"stdout\": \"hi\\n\"") != std::string::npos);
+    CHECK(out.find("ValueError: no") != std::string::npos);
+    CHECK(read_output(vm) == "{\"stdout\": \"\", \"stderr\": \"\"}");
+
+    // streamed to callbacks instead, up to 10 bytes each
+    Captured c;
+    CHECK(pkpy_vm_set_output_callbacks(vm, capture_out, capture_err, &c, 10));
+    CHECK(pkpy_vm_read_output(vm) == nullptr);
+    pkpy_vm_exec(vm, "print('a' * 6)\nprint('b' * 6)");
+    CHECK(c.out == "aaaaaa\nbbb");
+    pkpy_vm_exec(vm, "1 / 0");
+    CHECK(c.err == "Traceback ");
+    pkpy_delete(vm);
+
+    // flushed on demand in the middle of a run
+    vm = pkpy_new_vm(false);
+    Captured c2;
+    CHECK(pkpy_vm_set_output_callbacks(vm, capture_out, capture_err, &c2, -1));
+    pkpy_vm_bind_native(vm, "host", "seen", 0, seen, &c2);
+    pkpy_vm_exec(vm, "import host\nprint('x')\nassert host.seen() == 'x\\n'\nprint('y')");
+    CHECK(c2.out == "x\ny\n" && c2.err.empty());
+    pkpy_delete(vm);
+
+    vm = pkpy_new_vm(true);
+    CHECK(!pkpy_vm_set_output_callbacks(vm, capture_out, capture_err, &c, -1));
+    CHECK(pkpy_vm_read_output(vm) == nullptr);
+    pkpy_delete(vm);
+}
+
+/************ budget ************/
+static void test_budget(){
+    VM* vm = pkpy_new_vm(false);
+    pkpy_vm_set_budget(vm, 100000, -1, false);
+    pkpy_vm_exec(vm, "while True: pass");
+    CHECK(read_output(vm).find("TimeoutError") != std::string::npos);
+
+    // the handler gets one more slice, then it is raised again
+    pkpy_vm_exec(vm, "n = 0\ntry:\n  while True: pass\nexcept TimeoutError:\n  while True: n += 1");
+    CHECK(read_output(vm).find("TimeoutError") != std::string::npos);
+    i64 n = std::stoll(eval(vm, "n"));
+    CHECK(n > 0 && n <= 1024);
+
+    // each run has its own budget
+    pkpy_vm_exec(vm, "for i in range(50000): pass\nok = True");
+    CHECK(eval(vm, "ok") == "True");
+
+    pkpy_vm_set_budget(vm, -1, 0.05, false);
+    pkpy_vm_exec(vm, "while True: pass");
+    CHECK(read_output(vm).find("TimeoutError") != std::string::npos);
+
+    // handlers that keep running can't swallow it
+    auto t0 = std::chrono::steady_clock::now();
+    pkpy_vm_set_budget(vm, 100000, 0.5, false);
+    pkpy_vm_exec(vm, "while True:\n  try:\n    while True: pass\n  except: pass");
+    CHECK(read_output(vm).find("TimeoutError") != std::string::npos);
+    pkpy_vm_exec(vm, "def f():\n  try:\n    while True: pass\n  except:\n    f()\nf()");
+    CHECK(read_output(vm).find("TimeoutError") != std::string::npos);
+    CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::seconds(5));
+    pkpy_delete(vm);
+}
+
+static void test_suspend(){
+    VM* vm = pkpy_new_vm(false);
+    pkpy_vm_set_budget(vm, 5000, -1, true);
+    pkpy_vm_exec(vm,
+        "def g(i):\n"
+        "  return i\n"
+        "def f(k):\n"
+        "  s = 0\n"
+        "  for i in range(k):\n"
+        "    s += g(i)\n"
+        "  return s\n"
+        "r = f(100000)");
+    CHECK(pkpy_vm_is_suspended(vm));
+    int resumes = 0;
+    while(pkpy_vm_resume(vm)) resumes++;
+    CHECK(resumes > 10);
+    CHECK(!pkpy_vm_is_suspended(vm));
+    CHECK(eval(vm, "r") == "4999950000");
+    CHECK(read_output(vm) == "{\"stdout\": \"\", \"stderr\": \"\"}");
+
+    // a new run abandons a suspended one
+    pkpy_vm_exec(vm, "r = f(100000)");
+    CHECK(pkpy_vm_is_suspended(vm));
+    pkpy_vm_exec(vm, "r = 1");
+    CHECK(!pkpy_vm_is_suspended(vm));
+    CHECK(eval(vm, "r") == "1");
+    CHECK(!pkpy_vm_resume(vm));
+    pkpy_delete(vm);
+}
+
+static void test_interrupt(){
+    VM* vm = pkpy_new_vm(false);
+    std::thread t([vm](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        pkpy_vm_interrupt(vm);
+    });
+    pkpy_vm_exec(vm, "while True: pass");
+    t.join();
+    CHECK(read_output(vm).find("KeyboardInterrupt") != std::string::npos);
+
+    t = std::thread([vm](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        pkpy_vm_interrupt(vm);
+    });
+    pkpy_vm_exec(vm, "try:\n  while True: pass\nexcept KeyboardInterrupt:\n  caught = True");
+    t.join();
+    CHECK(eval(vm, "caught") == "True");
+
+    // a handler that keeps running is stopped past it
+    t = std::thread([vm](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        pkpy_vm_interrupt(vm);
+    });
+    pkpy_vm_exec(vm, "while True:\n  try:\n    while True: pass\n  except: pass");
+    t.join();
+    CHECK(read_output(vm).find("KeyboardInterrupt") != std::string::npos);
+
+    // an interrupt while idle doesn't reach the next run
+    pkpy_vm_interrupt(vm);
+    pkpy_vm_exec(vm, "for i in range(10000): pass\nidle_ok = True");
+    CHECK(eval(vm, "idle_ok") == "True");
+    pkpy_delete(vm);
+}
+
+/************ memory ************/
+static void test_memory_limit(){
+    VM* vm = pkpy_new_vm(false);
+    pkpy_vm_set_memory_limit(vm, 1 << 20);
+    pkpy_vm_exec(vm, "s = ''\nfor i in range(3000000): s += 'x'");
+    CHECK(read_output(vm).find("MemoryError") != std::string::npos);
+    pkpy_vm_exec(vm, "s = None");
+    CHECK(pkpy_vm_allocated_bytes(vm) < (1 << 20));
+
+    // the handler has some headroom to clean up, and the limit is back once it has
+    pkpy_vm_exec(vm,
+        "s = []\n"
+        "try:\n"
+        "  while True: s.append('x' * 10000)\n"
+        "except MemoryError:\n"
+        "  t = [0] * 5000\n"
+        "  s = None\n"
+        "  t = None\n"
+        "try:\n"
+        "  u = [0] * 200000\n"
+        "except MemoryError:\n"
+        "  ok = True");
+    CHECK(eval(vm, "ok") == "True");
+
+    // going past the headroom ends the run
+    pkpy_vm_exec(vm,
+        "s = []\n"
+        "try:\n"
+        "  while True: s.append('x' * 10000)\n"
+        "except MemoryError:\n"
+        "  try:\n"
+        "    u = [0] * 100000\n"
+        "  except MemoryError:\n"
+        "    caught_twice = True");
+    CHECK(read_output(vm).find("MemoryError") != std::string::npos);
+    pkpy_vm_exec(vm, "s = None");
+    CHECK(pkpy_vm_get_global(vm, "caught_twice") == nullptr);
+    pkpy_vm_exec(vm, "l = [0] * 100000\nok = len(l)");
+    CHECK(eval(vm, "ok") == "100000");
+    pkpy_vm_exec(vm, "l2 = [0] * 100000");
+    CHECK(read_output(vm).find("MemoryError") != std::string::npos);
+    pkpy_vm_exec(vm, "l = None");
+
+    // natives building large results check the limit before allocating
+    i64 before = pkpy_vm_allocated_bytes(vm);
+    pkpy_vm_exec(vm, "s = 'a' * 20000\nt = s.replace('a', s)");
+    CHECK(read_output(vm).find("MemoryError") != std::string::npos);
+    CHECK(pkpy_vm_allocated_bytes(vm) - before < (1 << 20));
+    pkpy_vm_exec(vm, "t = s + s\nt = s.encode() + s.encode()\nt = [s] + [s]\nt = None");
+    CHECK(read_output(vm) == "{\"stdout\": \"\", \"stderr\": \"\"}");
+
+    // a handler that keeps allocating past its headroom can't swallow it
+    pkpy_vm_exec(vm,
+        "s = []\n"
+        "while True:\n"
+        "  try:\n"
+        "    while True: s.append('x' * 10000)\n"
+        "  except: pass");
+    CHECK(read_output(vm).find("MemoryError") != std::string::npos);
+    pkpy_vm_exec(vm, "s = None");
+    pkpy_delete(vm);
+}
+
+static VM* other_vm;
+
+static PkHandle* churn(VM* vm, PkHandle** argv, int argc, void* userdata){
+    std::string s(100, 'x');
+    for(int i=0; i<1000; i++) pkpy_release(pkpy_new_str(other_vm, s.c_str(), (int)s.size()));
+    return nullptr;
+}
+
+static void test_two_heaps(){
+    VM* a = pkpy_new_vm(false);
+    VM* b = pkpy_new_vm(false);
+    CHECK(pkpy::_heap == nullptr);
+    pkpy_vm_exec(b, "import sys");
+    i64 base_a = pkpy_vm_allocated_bytes(a);
+    i64 base_b = pkpy_vm_allocated_bytes(b);
+
+    // handles of a, made and released outside of it or inside a run of b
+    std::vector<PkHandle*> handles;
+    for(int i=0; i<1000; i++) handles.push_back(pkpy_new_str(a, "abcdefghijklmnopqrstuvwxyz", 26));
+    CHECK(pkpy_vm_allocated_bytes(a) - base_a >= 1000 * 26);
+    for(PkHandle* h : handles) pkpy_release(h);
+    CHECK(pkpy_vm_allocated_bytes(a) == base_a);
+    CHECK(pkpy_vm_allocated_bytes(b) == base_b);
+
+    other_vm = a;
+    pkpy_vm_bind_native(b, "host", "churn", 0, churn, nullptr);
+    pkpy_vm_exec(b, "import host\nhost.churn()");
+    CHECK(pkpy_vm_allocated_bytes(a) == base_a);
+    CHECK(std::abs(pkpy_vm_allocated_bytes(b) - base_b) < 4096);
+
+    // a handle may outlive its vm
+    PkHandle* kept = pkpy_new_str(a, "kept", 4);
+    pkpy_delete(a);
+    CHECK(pkpy::_heap == nullptr);
+    pkpy_release(kept);
+
+    // a vm deleted on another thread than the one it was made on leaves neither with its heap
+    VM* c = pkpy_new_vm(false);
+    pkpy_vm_exec(c, "x = [1, 2, 3]");
+    std::thread([c](){
+        pkpy_delete(c);
+        CHECK(pkpy::_heap == nullptr);
+    }).join();
+    CHECK(pkpy::_heap == nullptr);
+    PkHandle* h = pkpy_new_list(b, nullptr, 0);
+    pkpy_release(h);
+    pkpy_delete(b);
+}
+
+/************ names ************/
+static void test_intern(){
+    // threads interning the same names concurrently get the same entries, across table growth
+    constexpr int kNames = 20000;
+    std::vector<std::vector<const Str*>> seen(4);
+    std::vector<std::thread> threads;
+    for(int t=0; t<4; t++){
+        threads.emplace_back([&seen, t](){
+            for(int i=0; i<kNames; i++) seen[t].push_back(StrName("name" + std::to_string(i))._s);
+        });
+    }
+    for(std::thread& t : threads) t.join();
+    for(int i=0; i<kNames; i++){
+        CHECK(*seen[0][i] == "name" + std::to_string(i));
+        for(int t=1; t<4; t++) CHECK(seen[t][i] == seen[0][i]);
+    }
+    CHECK(StrName("name7") == StrName(Str("name7")));
+}
+
+/************ asyncio ************/
+static void test_await_exception_values(){
+    VM* vm = pkpy_new_vm(false);
+    // exception objects are only raised at an `await` when they were raised
+    vm->bind_builtin_func<1>("make_error", [](VM* vm, pkpy::Args& args){
+        return vm->PyException(pkpy::Exception(vm->PyStr_AS_C(args[0]), "x"));
+    });
+    vm->bind_builtin_func<1>("is_error", [](VM* vm, pkpy::Args& args){
+        return vm->PyBool(args[0]->is_type(vm->tp_exception));
+    });
+    CHECK(run(vm,
+        "import asyncio\n"
+        "async def ret_error():\n"
+        "    return make_error('ValueError')\n"
+        "async def main():\n"
+        "    assert is_error(await ret_error())\n"
+        "    assert is_error(await asyncio.create_task(ret_error()))\n"
+        "    f = asyncio.Future()\n"
+        "    async def setter():\n"
+        "        await asyncio.sleep(0)\n"
+        "        f.set_result(make_error('KeyError'))\n"
+        "    asyncio.create_task(setter())\n"
+        "    assert is_error(await f)\n"
+        "    assert is_error(await f)\n"
+        "    assert is_error(f.result())\n"
+        "    return 'done'\n"
+        "assert asyncio.run(main()) == 'done'\n"
+        "assert is_error(asyncio.run(ret_error()))"));
+    pkpy_delete(vm);
+}
+
+static PkHandle* cancelled_op(VM* vm, PkHandle** argv, int argc, void* userdata){
+    pkpy::Completion* done;
+    PkHandle* fut = pkpy_new_host_future(vm, &done);
+    std::thread([done](){ pkpy_complete_cancel(done); }).detach();
+    return fut;
+}
+
+static void test_cancel_host_future(){
+    VM* vm = pkpy_new_vm(false);
+    pkpy_vm_bind_native(vm, "host", "op", 0, cancelled_op, nullptr);
+    CHECK(run(vm,
+        "import asyncio, host\n"
+        "async def main():\n"
+        "    try:\n"
+        "        await host.op()\n"
+        "    except CancelledError:\n"
+        "        return 'cancelled'\n"
+        "assert asyncio.run(main()) == 'cancelled'"));
+    pkpy_delete(vm);
+}
+
+int main(){
+    test_export_table();     // first, as it checks the global counters
+    test_bind_native();
+    test_handles();
+    test_compile();
+    test_output();
+    test_budget();
+    test_suspend();
+    test_interrupt();
+    test_memory_limit();
+    test_two_heaps();
+    test_intern();
+    test_await_exception_values();
+    test_cancel_host_future();
+    CHECK(PkHandle::live_count == 0);
+    return 0;
+}
@@ -75,4 +75,136 @@ assert isinstance(d, C)
 assert isinstance(d, B)
 assert isinstance(d, A)
 assert isinstance(object, object)
-assert isinstance(type, object)
\ No newline at end of file
+assert isinstance(type, object)
+# instance attributes, shared shapes and the fallback to a dict
+class P:
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+
+class Q:
+    def __init__(self, x, y):
+        self.y = y
+        self.x = x
+
+def get_x(o):
+    return o.x
+
+objs = [P(1, 2), Q(3, 4), P(5, 6), Q(7, 8)]
+assert [get_x(o) for o in objs] == [1, 3, 5, 7]
+assert [o.y for o in objs] == [2, 4, 6, 8]
+
+p = P(1, 2)
+p.x = 10
+p.z = 3
+assert (p.x, p.y, p.z) == (10, 2, 3)
+assert P(0, 0).x == 0
+assert not hasattr(P(0, 0), 'z')
+assert 'z' in dir(p) and 'x' in dir(p)
+
+del p.y
+assert not hasattr(p, 'y')
+assert get_x(p) == 10 and p.z == 3
+p.y = 20
+assert p.y == 20
+try:
+    del p.w
+    exit(1)
+except AttributeError:
+    pass
+
+# instance attributes shadow class attributes
+class K:
+    def get_k(self):
+        return self.k
+K.k = 'class'
+k = K()
+assert k.get_k() == 'class'
+k.k = 'instance'
+assert k.get_k() == 'instance' and K.k == 'class'
+
+many = P(0, 0)
+for i in range(100):
+    setattr(many, 'a' + str(i), i)
+assert getattr(many, 'a99') == 99 and many.a0 == 0 and many.x == 0
+
+# __slots__ gives a fixed layout
+class Vec:
+    __slots__ = ('x', 'y')
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+    def norm1(self):
+        return abs(self.x) + abs(self.y)
+
+v = Vec(3, -4)
+assert v.norm1() == 7
+assert Vec.__slots__ == ('x', 'y')
+try:
+    v.z = 1
+    exit(1)
+except AttributeError:
+    pass
+assert not hasattr(v, 'z')
+
+del v.x
+assert not hasattr(v, 'x')
+try:
+    del v.x
+    exit(1)
+except AttributeError:
+    pass
+v.x = 1
+assert v.norm1() == 5
+assert 'x' in dir(v) and 'y' in dir(v)
+try:
+    setattr(v, 'z', 1)
+    exit(1)
+except AttributeError:
+    pass
+assert v.norm1() == 5
+
+class Vec3(Vec):
+    __slots__ = ['z']
+    def __init__(self, x, y, z):
+        super().__init__(x, y)
+        self.z = z
+w = Vec3(1, 2, 3)
+assert (w.x, w.y, w.z) == (1, 2, 3)
+try:
+    w.t = 0
+    exit(1)
+except AttributeError:
+    pass
+
+# a subclass without __slots__ takes any attribute
+class FreeVec(Vec):
+    pass
+f = FreeVec(1, 2)
+f.t = 0
+assert f.t == 0 and f.norm1() == 3
+
+class Wide:
+    __slots__ = ('a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j')
+x = Wide()
+x.j = 10
+assert x.j == 10 and not hasattr(x, 'a')
+
+class Single:
+    __slots__ = 'v'
+s = Single()
+s.v = 1
+assert s.v == 1
+
+# a slot cannot share its name with a method of the class
+try:
+    exec("class Clash:\n    __slots__ = ('x', 'norm')\n    def norm(self):\n        return 0")
+    exit(1)
+except ValueError:
+    pass
+
+# larger layouts hold exactly their slots
+import sys
+class Wide2:
+    __slots__ = ('a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i')
+assert sys.getsizeof(Wide2()) - sys.getsizeof(Wide()) == -8
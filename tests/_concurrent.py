@@ -0,0 +1,48 @@
+import concurrent
+assert concurrent.current() == 0
+src = '''
+import concurrent
+while True:
+    msg = concurrent.recv()
+    if msg is None:
+        break
+    reply_to, n = msg
+    s = 0
+    for i in range(n):
+        s += i
+    concurrent.send(reply_to, (concurrent.current(), s, [1.5, 'x', True, None]))
+'''
+ids = [concurrent.spawn(src) for _ in range(2)]
+for i in ids:
+    concurrent.send(i, (0, 1000))
+got = []
+for i in ids:
+    got.append(concurrent.recv())
+for aid, s, extra in got:
+    assert aid in ids
+    assert s == 499500
+    assert extra == [1.5, 'x', True, None]
+for i in ids:
+    concurrent.send(i, None)
+try:
+    concurrent.send(99, 1)
+    exit(1)
+except ValueError:
+    pass
+try:
+    concurrent.send(ids[0], {'a': 1})
+    exit(1)
+except TypeError:
+    pass
+
+# finished actors give their mailbox slot back; their old ids stay invalid
+for _ in range(3000):
+    concurrent.spawn('pass')
+done = concurrent.spawn('import concurrent\nconcurrent.send(0, concurrent.current())')
+assert concurrent.recv() == done
+while True:
+    try:
+        concurrent.send(done, 1)
+    except ValueError:
+        break
+assert concurrent.spawn('pass') != done
@@ -65,3 +65,39 @@ while (count < 1000):
    count = count + 1
 assert count == 1000
 
+
+# leaving a loop to the first instruction of a following try block
+def first_after_break():
+    for i in range(3):
+        if i == 1:
+            break
+    try:
+        x = i
+    except:
+        x = -1
+    return x
+assert first_after_break() == 1
+
+def first_after_while():
+    while True:
+        break
+    try:
+        return 1
+    except:
+        return 2
+assert first_after_while() == 1
+
+n = 0
+for i in range(3):
+    for j in range(3):
+        if j == 1:
+            break
+        try:
+            n += 1
+        except:
+            pass
+    try:
+        n += 10
+    except:
+        pass
+assert n == 33
@@ -29,4 +29,16 @@ def f():
     exec(
         "exec('b = eval(\"3 + 5\")')"
     )
-    assert b == 8
\ No newline at end of file
+    assert b == 8
+import sys
+sys.clearcodecache()
+hits, misses, _ = sys.getcodecacheinfo()
+total = 0
+for i in range(10):
+    total += eval('i * 2')
+assert total == 90
+assert sys.getcodecacheinfo() == (hits + 9, misses + 1, 1)
+
+exec('c = 1')
+assert c == 1
+assert sys.getcodecacheinfo() == (hits + 9, misses + 2, 2)
@@ -11,3 +11,75 @@ with open('123.txt', 'a') as f:
 
 with open('123.txt', 'r') as f:
     assert f.read() == '123456' + '测试'
+
+with open('123.txt', 'w') as f:
+    f.write('line1\nline2\n\nlast')
+
+with open('123.txt') as f:
+    assert f.readline() == 'line1\n'
+    assert f.read(3) == 'lin'
+    assert [line for line in f] == ['e2\n', '\n', 'last']
+    assert f.readline() == ''
+
+with open('123.txt', 'wb') as f:
+    f.write(bytes([0, 1, 2, 255]) + 'abc'.encode())
+
+with open('123.txt', 'rb') as f:
+    b = f.read()
+    assert len(b) == 7 and b[3] == 255 and b[4:].decode() == 'abc'
+
+with open('123.txt', 'rb') as f:
+    buf = bytearray(2)
+    alias = buf
+    assert f.readinto(buf) == 2
+    assert buf == bytes([0, 1]) and alias[1] == 1
+    assert f.read(2) == bytes([2, 255])
+
+# bytes are immutable, so they can't be read into
+with open('123.txt', 'rb') as f:
+    b = bytes(2)
+    c = b
+    try:
+        f.readinto(b)
+        exit(1)
+    except TypeError:
+        pass
+    assert c == bytes(2)
+
+# text mode reads count characters, not bytes
+with open('123.txt', 'w') as f:
+    f.write('éé测a')
+with open('123.txt') as f:
+    assert f.read(1) == 'é'
+    assert f.read(2) == 'é测'
+    assert f.read(5) == 'a'
+
+# larger than the read buffer, read whole and after a partial read
+with open('123.txt', 'w') as f:
+    for i in range(100000):
+        f.write('0123456789abcdefghijklmnopqrstuvwxyz0123456789\n')
+with open('123.txt') as f:
+    assert len(f.read()) == 4700000
+with open('123.txt') as f:
+    assert f.read(3) == '012'
+    rest = f.read()
+    assert len(rest) == 4700000 - 3 and rest[:3] == '345' and rest[-1] == '\n'
+with open('123.txt') as f:
+    n = 0
+    for line in f:
+        assert len(line) == 47
+        n += 1
+    assert n == 100000
+
+# print() to a file
+with open('123.txt', 'w') as f:
+    print('a', 1, [2], file=f)
+    print('b', 'c', sep='-', end='!', file=f, flush=True)
+with open('123.txt') as f:
+    assert f.read() == 'a 1 [2]\nb-c!'
+
+try:
+    print(1, foo=2)
+    exit(1)
+except TypeError:
+    pass
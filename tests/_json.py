@@ -40,4 +40,7 @@ assert c == _c
 d = True
 _j = json.dumps(d)
 _d = json.loads(_j)
-assert d == _d
\ No newline at end of file
+assert d == _d
+# floats keep full precision
+assert json.dumps([0.1, 1/3, 1e16, 2.0]) == '[0.1, 0.3333333333333333, 1e+16, 2.0]'
+assert json.loads(json.dumps(1/3)) == 1/3
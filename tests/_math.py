@@ -25,4 +25,19 @@ assert floor(-1.2) == -2
 assert ceil(1.2) == 2
 assert ceil(-1.2) == -1
 
-assert isclose(sqrt(4), 2.0)
\ No newline at end of file
+assert isclose(sqrt(4), 2.0)
+assert type(sqrt(4)) is float
+assert type(floor(1.5)) is int
+assert type(isnan(1)) is bool
+
+try:
+    sqrt('4')
+    exit(1)
+except TypeError:
+    pass
+
+try:
+    sqrt(1, 2)
+    exit(1)
+except TypeError:
+    pass
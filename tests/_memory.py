@@ -0,0 +1,66 @@
+import sys
+
+base = sys.getallocatedbytes()
+assert base > 0
+
+a = [0] * 10000
+assert sys.getsizeof(a) >= 10000 * 8
+assert sys.getallocatedbytes() - base >= 10000 * 8
+del a
+assert sys.getallocatedbytes() - base < 1000
+
+s = 'x' * 5000
+assert sys.getsizeof(s) > 5000
+assert sys.getsizeof(s) > sys.getsizeof('x')
+s = None
+
+# so is appending to a string in place
+s = ''
+before = sys.getallocatedbytes()
+for i in range(10000):
+    s += 'x'
+assert sys.getallocatedbytes() - before >= 10000
+s = None
+
+# growing a list is charged as it grows
+b = []
+before = sys.getallocatedbytes()
+for i in range(1000):
+    b.append(None)
+assert sys.getallocatedbytes() - before >= 1000 * 8
+b = None
+
+class A:
+    pass
+
+x = A()
+small = sys.getsizeof(x)
+for i in range(50):
+    setattr(x, 'a' + str(i), i)
+assert sys.getsizeof(x) > small
+
+# builtin singletons and types are immortal: references to them are not counted
+n = sys.getrefcount(None)
+l = [None, True, int] * 100
+assert sys.getrefcount(None) == n
+y = A()
+n = sys.getrefcount(y)
+l = [y] * 100
+assert sys.getrefcount(y) == n + 100
+l = None
+
+# instances keep their attributes in a small array rather than a dict
+class Point:
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+assert sys.getsizeof(Point(1, 2)) <= 64
+
+# each class grows its own shapes, however many other classes there are
+for i in range(40):
+    exec('class C' + str(i) + ':\n    def __init__(self):\n        self.f' + str(i) + ' = 1\nC' + str(i) + '()')
+class Point2:
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+assert sys.getsizeof(Point2(1, 2)) <= 64
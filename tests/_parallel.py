@@ -0,0 +1,58 @@
+import parallel
+import math
+
+def sq(x):
+    return x * x
+assert parallel.map(sq, range(100)) == [i*i for i in range(100)]
+assert parallel.map(sq, []) == []
+assert parallel.map(sq, [3], workers=1) == [9]
+
+# globals, helper functions and modules travel with the function
+K = 3
+def helper(x):
+    return x + K
+def g(x):
+    return helper(x) * 2 + math.floor(1.5)
+assert parallel.map(g, [1, 2, 3], workers=3) == [9, 11, 13]
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n-1) + fib(n-2)
+assert parallel.map(fib, range(15)) == [fib(i) for i in range(15)]
+
+def make_adder(n):
+    def add(x, y=1):
+        return x + n + y
+    return add
+assert parallel.map(make_adder(10), range(4)) == [11, 12, 13, 14]
+assert parallel.map(abs, [-1, -2, 3]) == [1, 2, 3]
+
+def pair(x):
+    return (x, [x, str(x)])
+assert parallel.map(pair, range(3)) == [(0, [0, '0']), (1, [1, '1']), (2, [2, '2'])]
+
+def bad(x):
+    return 1 // (x - 50)
+try:
+    parallel.map(bad, range(100))
+    exit(1)
+except ZeroDivisionError:
+    pass
+
+class A:
+    pass
+a = A()
+def uses_a(x):
+    return a
+try:
+    parallel.map(uses_a, range(10))
+    exit(1)
+except TypeError:
+    pass
+
+try:
+    parallel.map(sq, range(10), workers=0)
+    exit(1)
+except ValueError:
+    pass
@@ -16,4 +16,31 @@ assert re.split(',','123,456,789,10') == ['123', '456', '789', '10']
 assert re.split(',',',123,456,789,10') == ['', '123', '456', '789', '10']
 assert re.split(',','123,456,789,10,') == ['123', '456', '789', '10']
 
-assert re.match('1','1') is not None
\ No newline at end of file
+assert re.match('1','1') is not None
+# compiled patterns, groups and streaming matches
+p = re.compile(r'(\w+)@(\w+)\.com')
+m = p.search('mail: bob@example.com!')
+assert m.group() == 'bob@example.com'
+assert m.groups() == ('bob', 'example')
+assert m.group(-1) == 'example' and m.group(-3) == 'bob@example.com'
+try:
+    m.group(3)
+    exit(1)
+except IndexError:
+    pass
+assert m.span() == (6, 21)
+assert p.match('mail: bob@example.com') is None
+assert p.findall('a@b.com, c@d.com') == [('a', 'b'), ('c', 'd')]
+assert re.findall(r'\d+', 'a1b22c333') == ['1', '22', '333']
+assert re.findall('ab', 'abcabab') == ['ab', 'ab', 'ab']
+assert [m.start() for m in re.finditer('测', '1测2测')] == [1, 3]
+assert [m.group(0) for m in p.finditer('x@y.com z@w.com')] == ['x@y.com', 'z@w.com']
+assert re.findall('a*', 'baa') == ['', 'aa', '']
+assert re.sub(r'(\d)', '<$1>', 'a1b2') == 'a<1>b<2>'
+assert re.match('1','1').group(0) == '1'
+
+try:
+    re.compile('(')
+    exit(1)
+except ValueError:
+    pass